@@ -0,0 +1,76 @@
+/* Helpers shared by the benchmarks and tests. Each of them runs its server on a thread of its own process. */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../ece454rpc_types.h"
+
+/* bench_now_ns() -- returns the monotonic time in nanoseconds. */
+static inline uint64_t bench_now_ns()
+{
+    struct timespec s_timespec;
+
+    clock_gettime( CLOCK_MONOTONIC, &s_timespec );
+    return ( uint64_t )s_timespec.tv_sec * 1000000000ULL + s_timespec.tv_nsec;
+}
+
+/* bench_echo() -- a procedure that echoes its one argument through the
+ * pooled reply buffer, for registering as "echo". */
+static inline return_type bench_echo( const int nparams, arg_type* a )
+{
+    return_type s_return_type = { NULL, 0 };
+    int capacity;
+    void* p_reply = rpc_reply_buffer( &capacity );
+
+    if( nparams == 1 && a->arg_size <= capacity )
+    {
+        memcpy( p_reply, a->arg_val, a->arg_size );
+        s_return_type.return_val = p_reply;
+        s_return_type.return_size = a->arg_size;
+    }
+
+    return s_return_type;
+}
+
+static void* bench_server_main( void* p_unused )
+{
+    launch_server();
+    return NULL;
+}
+
+/* bench_start_server() -- runs launch_server() on a new thread, once the
+ * benchmark has registered its procedures, and returns the port it listens
+ * on, or 0 if it did not start. */
+static inline int bench_start_server()
+{
+    char port_file[64];
+    FILE* p_file;
+    pthread_t thread;
+    int port = 0;
+    int idx;
+
+    snprintf( port_file, sizeof( port_file ), "/tmp/rpc_bench.%d.port", ( int )getpid() );
+    unlink( port_file );
+    rpc_set_server_port_file( port_file );
+    pthread_create( &thread, NULL, bench_server_main, NULL );
+
+    for( idx = 0; idx < 1000 && port == 0; idx++ )
+    {
+        if( ( p_file = fopen( port_file, "r" ) ) != NULL )
+        {
+            if( fscanf( p_file, "%d", &port ) != 1 )
+            {
+                port = 0;
+            }
+
+            fclose( p_file );
+        }
+
+        usleep( 1000 );
+    }
+
+    unlink( port_file );
+    return port;
+}
@@ -0,0 +1,125 @@
+/* Measures compression against payload size and entropy. For each payload it reports the compression ratio, the
+ * codec throughput, and the rate of echo calls through the stubs with compression disabled and enabled.
+ * Payloads of k bits of entropy per byte draw every byte uniformly from 2^k symbols.
+ *
+ * Usage: compress_bench.out [echo calls per payload] */
+#include <stdlib.h>
+#include <string.h>
+#include "bench_util.h"
+#include "../ece454rpc_protocol.h"
+
+#define CODEC_ROUNDS 20000 ///< Times each payload is compressed and decompressed
+
+/**
+ * @brief Times echo calls of a payload.
+ *
+ * @return The number of calls per second, or 0 if a reply came back wrong.
+ */
+static double echo_rate( int port, const char* p_payload, int size, int calls )
+{
+    return_type s_return_type; ///< The current reply.
+    uint64_t start_ns = bench_now_ns(); ///< When the first call was made.
+    int idx;                   ///< An index for for loops.
+
+    for( idx = 0; idx < calls; idx++ )
+    {
+        s_return_type = make_remote_call_borrowed( "127.0.0.1", port, "echo", 1, size, p_payload );
+
+        if( s_return_type.return_size != size || memcmp( s_return_type.return_val, p_payload, size ) != 0 )
+        {
+            release_return_value( &s_return_type );
+            return 0;
+        }
+
+        release_return_value( &s_return_type );
+    }
+
+    return calls / ( ( bench_now_ns() - start_ns ) / 1e9 );
+}
+
+int main( int argc, char** argv )
+{
+    static const int sizes[] = { 512, 1024, 2048, 3968 }; ///< The payload sizes in bytes.
+    static const int entropies[] = { 0, 2, 4, 6, 8 };     ///< The payload entropies in bits per byte.
+    char payload[RPC_BUFFER_SIZE];                         ///< The payload.
+    char compressed[RPC_BUFFER_SIZE];                      ///< The compressed payload.
+    char decompressed[RPC_BUFFER_SIZE];                    ///< The decompressed payload.
+    int calls = argc > 1 ? atoi( argv[1] ) : 5000;         ///< Echo calls per payload.
+    int compressed_size;                                   ///< The size of the compressed payload.
+    int port;                                              ///< The port of the server.
+    int size_idx;                                          ///< An index over sizes.
+    int entropy_idx;                                       ///< An index over entropies.
+    int idx;                                               ///< An index for for loops.
+    uint64_t start_ns;                                     ///< When the current measurement started.
+    double compress_mbps;                                  ///< The compression throughput.
+    double decompress_mbps = 0;                            ///< The decompression throughput.
+    double plain_rate;                                     ///< Echo calls per second without compression.
+    double compressed_rate;                                ///< Echo calls per second with compression.
+
+    register_procedure( "echo", 1, bench_echo );
+
+    if( ( port = bench_start_server() ) == 0 )
+    {
+        fprintf( stderr, "compress_bench: the server did not start.\n" );
+        return 1;
+    }
+
+    srand( 454 );
+    printf( "%6s %8s %7s %13s %15s %12s %12s\n", "bytes", "bits/B", "ratio", "compress MB/s", "decompress MB/s", "calls/s off", "calls/s on" );
+
+    for( size_idx = 0; size_idx < ( int )( sizeof( sizes ) / sizeof( sizes[0] ) ); size_idx++ )
+    {
+        for( entropy_idx = 0; entropy_idx < ( int )( sizeof( entropies ) / sizeof( entropies[0] ) ); entropy_idx++ )
+        {
+            for( idx = 0; idx < sizes[size_idx]; idx++ )
+            {
+                payload[idx] = ( char )( rand() & ( ( 1 << entropies[entropy_idx] ) - 1 ) );
+            }
+
+            // Codec throughput, counted in uncompressed bytes. A payload that does not shrink is sent as is.
+            start_ns = bench_now_ns();
+
+            for( idx = 0; idx < CODEC_ROUNDS; idx++ )
+            {
+                compressed_size = rpc_compress( payload, sizes[size_idx], compressed, sizes[size_idx] - 1 );
+            }
+
+            compress_mbps = ( double )sizes[size_idx] * CODEC_ROUNDS / ( ( bench_now_ns() - start_ns ) / 1e3 );
+            if( compressed_size > 0 )
+            {
+                start_ns = bench_now_ns();
+
+                for( idx = 0; idx < CODEC_ROUNDS; idx++ )
+                {
+                    rpc_decompress( compressed, compressed_size, decompressed, sizes[size_idx] );
+                }
+
+                decompress_mbps = ( double )sizes[size_idx] * CODEC_ROUNDS / ( ( bench_now_ns() - start_ns ) / 1e3 );
+            }
+
+            rpc_set_compression_threshold( -1 );
+            plain_rate = echo_rate( port, payload, sizes[size_idx], calls );
+            rpc_set_compression_threshold( RPC_COMPRESSION_THRESHOLD );
+            compressed_rate = echo_rate( port, payload, sizes[size_idx], calls );
+
+            // A payload that does not shrink is reported without a ratio or decompression throughput.
+            if( compressed_size > 0 )
+            {
+                printf( "%6d %8d %7.2f %13.0f %15.0f %12.0f %12.0f\n", sizes[size_idx], entropies[entropy_idx],
+                        ( double )sizes[size_idx] / compressed_size, compress_mbps, decompress_mbps, plain_rate, compressed_rate );
+            }
+            else
+            {
+                printf( "%6d %8d %7s %13.0f %15s %12.0f %12.0f\n", sizes[size_idx], entropies[entropy_idx], "-", compress_mbps, "-", plain_rate, compressed_rate );
+            }
+
+            if( plain_rate == 0 || compressed_rate == 0 )
+            {
+                fprintf( stderr, "compress_bench: an echo call returned a wrong reply.\n" );
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* Measures how long a fleet of servers on one host takes to become ready. Each server is a forked process with a
+ * port file of its own, and is ready once it prints its address. The fleet is started twice: first with no port
+ * files, so every server searches for a free port, then again with the port files the first start left behind.
+ *
+ * Usage: fleet_bench.out [servers] */
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "bench_util.h"
+
+#define MAX_SERVERS      100   ///< The port range of mybind() holds 101 ports
+#define FLEET_TIMEOUT_MS 10000 ///< How long the fleet may take to become ready
+
+/**
+ * @brief Does nothing; the fleet only needs a procedure to serve.
+ */
+static return_type nop( const int nparams, arg_type* a )
+{
+    return_type s_return_type = { NULL, 0 }; ///< The empty result.
+
+    return s_return_type;
+}
+
+/**
+ * @brief Runs one server of the fleet. Never returns.
+ */
+static void run_server( int ready_fd, const char* p_port_dir, int index )
+{
+    char port_file[256]; ///< The port file of this server.
+
+    dup2( ready_fd, STDOUT_FILENO );
+    snprintf( port_file, sizeof( port_file ), "%s/%d.port", p_port_dir, index );
+    rpc_set_server_port_file( port_file );
+    register_procedure( "nop", 0, nop );
+    launch_server();
+    exit( 1 );
+}
+
+/**
+ * @brief Starts a fleet, waits until every server has printed its address, then stops it.
+ *
+ * @param servers     The number of servers.
+ * @param p_port_dir  The directory holding the port files.
+ * @param p_ready_ns  Receives the time at which each server became ready, in order.
+ * @param p_ports     Receives the number of distinct ports the servers listen on.
+ *
+ * @return The number of servers that became ready in time.
+ */
+static int run_fleet( int servers, const char* p_port_dir, uint64_t* p_ready_ns, int* p_ports )
+{
+    static bool s_port_taken[65536];   ///< Which ports a server has announced.
+    pid_t pids[MAX_SERVERS];           ///< The server processes.
+    int pipe_fds[2];                   ///< Every server prints its address to this pipe.
+    char buffer[4096];                 ///< Text read from the pipe.
+    char line[64];                     ///< The address line being read.
+    size_t line_length = 0;            ///< The length of line.
+    struct pollfd s_pollfd;            ///< The read end of the pipe.
+    uint64_t start_ns;                 ///< When the first server was started.
+    unsigned int port;                 ///< The port of the last announced server.
+    ssize_t size;                      ///< The number of bytes read from the pipe.
+    int ready = 0;                     ///< The number of servers that are ready.
+    int idx;                           ///< An index for for loops.
+    ssize_t pos;                       ///< A position in buffer.
+
+    memset( s_port_taken, 0, sizeof( s_port_taken ) );
+    *p_ports = 0;
+
+    if( pipe( pipe_fds ) < 0 )
+    {
+        perror( "pipe" );
+        return 0;
+    }
+
+    start_ns = bench_now_ns();
+
+    for( idx = 0; idx < servers; idx++ )
+    {
+        if( ( pids[idx] = fork() ) == 0 )
+        {
+            close( pipe_fds[0] );
+            run_server( pipe_fds[1], p_port_dir, idx );
+        }
+    }
+
+    close( pipe_fds[1] );
+    s_pollfd.fd = pipe_fds[0];
+    s_pollfd.events = POLLIN;
+
+    // Each address line is shorter than PIPE_BUF, so lines from different servers never interleave.
+    while( ready < servers && bench_now_ns() - start_ns < FLEET_TIMEOUT_MS * 1000000ULL && poll( &s_pollfd, 1, 100 ) >= 0 )
+    {
+        if( !( s_pollfd.revents & POLLIN ) || ( size = read( pipe_fds[0], buffer, sizeof( buffer ) ) ) <= 0 )
+        {
+            continue;
+        }
+
+        for( pos = 0; pos < size; pos++ )
+        {
+            if( buffer[pos] != '\n' )
+            {
+                line[line_length < sizeof( line ) - 1 ? line_length++ : line_length] = buffer[pos];
+                continue;
+            }
+
+            line[line_length] = '\0';
+            line_length = 0;
+            p_ready_ns[ready++] = bench_now_ns() - start_ns;
+
+            if( sscanf( line, "%*s %u", &port ) == 1 && port < 65536 && !s_port_taken[port] )
+            {
+                s_port_taken[port] = true;
+                ( *p_ports )++;
+            }
+        }
+    }
+
+    for( idx = 0; idx < servers; idx++ )
+    {
+        if( pids[idx] > 0 )
+        {
+            kill( pids[idx], SIGKILL );
+            waitpid( pids[idx], NULL, 0 );
+        }
+    }
+
+    close( pipe_fds[0] );
+    return ready;
+}
+
+/**
+ * @brief Runs a fleet and reports how long it took to become ready.
+ *
+ * @return Returns true if every server became ready in time.
+ */
+static bool report_fleet( const char* p_label, int servers, const char* p_port_dir )
+{
+    uint64_t ready_ns[MAX_SERVERS]; ///< When each server became ready.
+    int ports;                      ///< The number of distinct ports.
+    int ready = run_fleet( servers, p_port_dir, ready_ns, &ports ); ///< The number of servers that became ready.
+
+    if( ready == 0 )
+    {
+        printf( "%-12s 0/%d ready\n", p_label, servers );
+        return false;
+    }
+
+    printf( "%-12s %d/%d ready, median %.1f ms, all %.1f ms, %d distinct ports\n", p_label, ready, servers,
+            ready_ns[ready / 2] / 1e6, ready_ns[ready - 1] / 1e6, ports );
+    return ready == servers;
+}
+
+int main( int argc, char** argv )
+{
+    int servers = argc > 1 ? atoi( argv[1] ) : MAX_SERVERS; ///< The size of the fleet.
+    char port_dir[] = "/tmp/rpc_fleet.XXXXXX";              ///< The directory holding the port files.
+    char port_file[64];                                     ///< The port file of one server.
+    bool all_ready;                                         ///< Whether every server of both fleets became ready.
+    int idx;                                                ///< An index for for loops.
+
+    servers = servers < 1 ? 1 : servers > MAX_SERVERS ? MAX_SERVERS : servers;
+
+    if( mkdtemp( port_dir ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+
+    // Flush before forking, so the servers do not repeat buffered output.
+    fflush( stdout );
+    all_ready = report_fleet( "first start:", servers, port_dir );
+    fflush( stdout );
+    all_ready = report_fleet( "restart:", servers, port_dir ) && all_ready;
+
+    // A server that never wrote its port file leaves nothing to remove.
+    for( idx = 0; idx < servers; idx++ )
+    {
+        snprintf( port_file, sizeof( port_file ), "%s/%d.port", port_dir, idx );
+        unlink( port_file );
+    }
+
+    if( rmdir( port_dir ) < 0 )
+    {
+        perror( "rmdir" );
+    }
+
+    return all_ready ? 0 : 1;
+}
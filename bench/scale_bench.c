@@ -0,0 +1,98 @@
+/* Measures how the call rate of one client process scales with the number of calling threads, from 1 to
+ * MAX_THREADS. Every thread calls the same server, so the threads share the client stub's sockets.
+ *
+ * Usage: scale_bench.out [calls per thread count] */
+#include <stdlib.h>
+#include "bench_util.h"
+
+#define MAX_THREADS 64 ///< The largest number of calling threads
+
+static int s_port;             ///< The port of the server.
+static int s_calls_per_thread; ///< The number of calls each thread makes.
+static int s_failures;         ///< The number of calls that came back wrong.
+
+/**
+ * @brief Adds its two int arguments.
+ */
+static return_type addtwo( const int nparams, arg_type* a )
+{
+    static __thread int s_result;            ///< The sum, which outlives the call.
+    return_type s_return_type = { NULL, 0 }; ///< The sum, or nothing if the arguments are wrong.
+
+    if( nparams == 2 && a->arg_size == sizeof( int ) && a->next->arg_size == sizeof( int ) )
+    {
+        s_result = *( int* )a->arg_val + *( int* )a->next->arg_val;
+        s_return_type.return_val = &s_result;
+        s_return_type.return_size = sizeof( int );
+    }
+
+    return s_return_type;
+}
+
+/**
+ * @brief Makes a thread's share of the calls.
+ */
+static void* call_main( void* p_unused )
+{
+    return_type s_return_type; ///< The current reply.
+    int a = 1;                 ///< The first argument.
+    int b = 2;                 ///< The second argument.
+    int idx;                   ///< An index for for loops.
+
+    for( idx = 0; idx < s_calls_per_thread; idx++ )
+    {
+        s_return_type = make_remote_call_borrowed( "127.0.0.1", s_port, "addtwo", 2, sizeof( int ), &a, sizeof( int ), &b );
+
+        if( s_return_type.return_size != sizeof( int ) || *( int* )s_return_type.return_val != 3 )
+        {
+            __atomic_add_fetch( &s_failures, 1, __ATOMIC_RELAXED );
+        }
+
+        release_return_value( &s_return_type );
+    }
+
+    return NULL;
+}
+
+int main( int argc, char** argv )
+{
+    int calls = argc > 1 ? atoi( argv[1] ) : 64000; ///< The number of calls made at each thread count.
+    pthread_t threads[MAX_THREADS];                  ///< The calling threads.
+    uint64_t start_ns;                               ///< When the first thread was started.
+    double seconds;                                  ///< How long the calls took.
+    int thread_count;                                ///< The current number of calling threads.
+    int idx;                                         ///< An index for for loops.
+
+    register_procedure( "addtwo", 2, addtwo );
+    s_port = bench_start_server();
+
+    if( s_port == 0 )
+    {
+        fprintf( stderr, "The server did not start.\n" );
+        return 1;
+    }
+
+    printf( "%8s %12s %9s\n", "threads", "calls/s", "failures" );
+
+    for( thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2 )
+    {
+        s_calls_per_thread = calls / thread_count;
+        s_failures = 0;
+        start_ns = bench_now_ns();
+
+        for( idx = 0; idx < thread_count; idx++ )
+        {
+            pthread_create( &threads[idx], NULL, call_main, NULL );
+        }
+
+        for( idx = 0; idx < thread_count; idx++ )
+        {
+            pthread_join( threads[idx], NULL );
+        }
+
+        seconds = ( bench_now_ns() - start_ns ) / 1e9;
+        printf( "%8d %12.0f %9d\n", thread_count, s_calls_per_thread * thread_count / seconds, s_failures );
+    }
+
+    return 0;
+}
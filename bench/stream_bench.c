@@ -0,0 +1,154 @@
+/* Compares a large result produced by a streaming procedure with the same result returned as one blob by a
+ * regular procedure. Reports the time to the first byte, the total time and the peak RSS of the process, which
+ * holds both the server and the client. Each path runs in a process of its own, so their peak RSS is separate.
+ *
+ * Usage: stream_bench.out [result size in MB] */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "bench_util.h"
+
+#define STREAM_PIECE_SIZE 4000 ///< Size of each chunk the streaming procedure writes
+
+/* The size of the result in bytes. */
+static size_t s_result_size;
+
+/**
+ * @brief Fills part of the result, as a scan or export would produce it.
+ */
+static void fill_result( char* p_buffer, size_t offset, size_t size )
+{
+    size_t idx; ///< An index for for loops.
+
+    for( idx = 0; idx < size; idx++ )
+    {
+        p_buffer[idx] = ( char )( ( offset + idx ) * 31 );
+    }
+}
+
+/**
+ * @brief Produces the result piece by piece through the stream writer.
+ */
+static void scan_stream( const int nparams, arg_type* a, stream_writer_type writer, rpc_stream* p_stream )
+{
+    char piece[STREAM_PIECE_SIZE]; ///< The piece being produced.
+    size_t offset;                 ///< The offset of the piece in the result.
+    size_t size;                   ///< The size of the piece.
+
+    for( offset = 0; offset < s_result_size; offset += size )
+    {
+        size = s_result_size - offset < STREAM_PIECE_SIZE ? s_result_size - offset : STREAM_PIECE_SIZE;
+        fill_result( piece, offset, size );
+
+        if( !writer( p_stream, piece, size ) )
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Produces the whole result in memory and returns it as one blob.
+ */
+static return_type scan_blob( const int nparams, arg_type* a )
+{
+    static char* sp_blob = NULL; ///< The result. The stub does not free return values.
+    return_type s_return_type;   ///< The result.
+
+    if( sp_blob == NULL )
+    {
+        sp_blob = ( char* )malloc( s_result_size );
+    }
+
+    fill_result( sp_blob, 0, s_result_size );
+    s_return_type.return_val = sp_blob;
+    s_return_type.return_size = s_result_size;
+    return s_return_type;
+}
+
+/**
+ * @brief Runs one path and prints its measurements.
+ *
+ * @param blob Whether to use the blob path, which the client also gathers into one buffer.
+ */
+static int run( bool blob )
+{
+    rpc_stream_call* sp_stream_call; ///< The call being consumed.
+    return_type s_chunk;             ///< The current chunk.
+    char* p_gathered = NULL;         ///< The whole result, gathered by a blob client.
+    size_t received = 0;             ///< The number of bytes received.
+    uint64_t start_ns;               ///< When the call was made.
+    uint64_t first_byte_ns = 0;      ///< When the first chunk arrived.
+    struct rusage s_rusage;          ///< The resource usage of the process.
+    int port;                        ///< The port of the server.
+
+    register_stream_procedure( "scan_stream", 0, scan_stream );
+    register_procedure( "scan_blob", 0, scan_blob );
+
+    if( ( port = bench_start_server() ) == 0 )
+    {
+        fprintf( stderr, "stream_bench: the server did not start.\n" );
+        return 1;
+    }
+
+    start_ns = bench_now_ns();
+    sp_stream_call = open_stream_call( "127.0.0.1", port, blob ? "scan_blob" : "scan_stream", 0 );
+
+    if( blob )
+    {
+        p_gathered = ( char* )malloc( s_result_size );
+    }
+
+    while( sp_stream_call != NULL && next_stream_chunk( sp_stream_call, &s_chunk ) )
+    {
+        if( first_byte_ns == 0 )
+        {
+            first_byte_ns = bench_now_ns();
+        }
+
+        if( blob && received + s_chunk.return_size <= s_result_size )
+        {
+            memcpy( p_gathered + received, s_chunk.return_val, s_chunk.return_size );
+        }
+
+        received += s_chunk.return_size;
+    }
+
+    if( !close_stream_call( sp_stream_call ) || received != s_result_size )
+    {
+        fprintf( stderr, "stream_bench: received %zu of %zu bytes.\n", received, s_result_size );
+        return 1;
+    }
+
+    getrusage( RUSAGE_SELF, &s_rusage );
+    printf( "%-6s %6zu MB  first byte %9.3f ms  total %9.1f ms  peak RSS %7ld KB\n", blob ? "blob" : "stream", s_result_size >> 20,
+            ( first_byte_ns - start_ns ) / 1e6, ( bench_now_ns() - start_ns ) / 1e6, s_rusage.ru_maxrss );
+
+    free( p_gathered );
+    return 0;
+}
+
+int main( int argc, char** argv )
+{
+    int status;  ///< The exit status of a path.
+    int failed = 0; ///< Whether any path failed.
+    int idx;     ///< An index for for loops.
+
+    s_result_size = ( size_t )( argc > 1 ? atoi( argv[1] ) : 64 ) << 20;
+
+    for( idx = 0; idx < 2; idx++ )
+    {
+        fflush( stdout );
+
+        if( fork() == 0 )
+        {
+            exit( run( idx == 1 ) );
+        }
+
+        wait( &status );
+        failed |= !WIFEXITED( status ) || WEXITSTATUS( status ) != 0;
+    }
+
+    return failed;
+}
@@ -0,0 +1,62 @@
+/* Measures what tracing adds to a request served on the receive loop, through the same calls the server stub makes:
+ * trace_clock() when the request is received (which doubles as its dispatch time, and as the send time of the request
+ * before it), a clock read when the procedure returns if the request is sampled, and trace_request() once the reply is
+ * sent. The budget is TRACE_BUDGET_NS per unsampled request.
+ *
+ * Usage: trace_bench.out [requests] */
+#include <stdlib.h>
+#include "bench_util.h"
+#include "../rpc_trace.h"
+
+#define TRACE_BUDGET_NS 50 ///< The tracing cost an unsampled request may pay
+
+/**
+ * @brief Times tracing a number of requests.
+ *
+ * @return The tracing cost per request in nanoseconds.
+ */
+static double trace_cost_ns( long requests, bool sampled )
+{
+    uint64_t start_ns = bench_now_ns(); ///< When the first request was traced.
+    uint64_t recv_ticks;                ///< When the current request was received.
+    long idx;                           ///< An index for for loops.
+
+    for( idx = 0; idx < requests; idx++ )
+    {
+        recv_ticks = trace_clock();
+        trace_request( idx, "bench", 0x0100007f, 0, sampled ? TRACE_FLAG_SAMPLED : 0, recv_ticks, recv_ticks, sampled ? trace_now() : 0 );
+    }
+
+    trace_idle();
+    return ( double )( bench_now_ns() - start_ns ) / requests;
+}
+
+int main( int argc, char** argv )
+{
+    long requests = argc > 1 ? atol( argv[1] ) : 10000000; ///< The number of requests traced per run.
+    uint64_t start_ns;                                      ///< When the clock reads started.
+    double clock_read_ns;                                   ///< The cost of one clock read.
+    double unsampled_ns;                                    ///< The tracing cost of an unsampled request.
+    double sampled_ns;                                      ///< The tracing cost of a sampled request.
+    volatile uint64_t ticks;                                ///< The result of the last clock read.
+    long idx;                                               ///< An index for for loops.
+
+    trace_start();
+
+    start_ns = bench_now_ns();
+
+    for( idx = 0; idx < requests; idx++ )
+    {
+        ticks = trace_now();
+    }
+
+    clock_read_ns = ( double )( bench_now_ns() - start_ns ) / requests;
+    unsampled_ns = trace_cost_ns( requests, false );
+    sampled_ns = trace_cost_ns( requests, true );
+
+    printf( "clock read: %.1f ns\n", clock_read_ns );
+    printf( "unsampled request: %.1f ns (budget %d ns)\n", unsampled_ns, TRACE_BUDGET_NS );
+    printf( "sampled request:   %.1f ns\n", sampled_ns );
+
+    return unsampled_ns < TRACE_BUDGET_NS ? 0 : 1;
+}
@@ -1,19 +1,37 @@
 #include <arpa/inet.h>
+#include <errno.h>
+#include <linux/futex.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include "ece454rpc_types.h"
+#include "ece454rpc_protocol.h"
 
-#define BUFFER_SIZE 4096
+#define BUFFER_SIZE RPC_BUFFER_SIZE
+#define RECV_POOL_SLOTS 4
+
+#define CLIENT_SOCKET_COUNT   4           ///< Number of UDP sockets shared by every thread of the process, each with its own receiver thread
+#define CLIENT_SOCKET_RCVBUF  ( 1 << 20 ) ///< Receive buffer requested for each shared socket, so a burst of replies is not dropped
+#define PENDING_CALL_BUCKETS  256         ///< Number of buckets of the table of calls waiting for a reply. Must be a power of two.
+
+/* Values of pending_call::m_state, which is also the futex word the calling thread sleeps on */
+#define CALL_WAITING  0 /* no reply yet */
+#define CALL_SLEEPING 1 /* no reply yet, and the calling thread is asleep on the futex */
+#define CALL_REPLIED  2 /* the reply has been stored in m_buffer */
 
 /** @struct
- 
+
     @brief Defines a structure for a variable argument in make_remote_call().
 */
 struct var_arg
@@ -22,6 +40,624 @@ struct var_arg
     void*  m_p_arg;    ///< A pointer to the value of the variable argument
 };
 
+/** @struct
+
+    @brief Defines a pooled receive buffer that a return value may borrow from.
+*/
+struct recv_slot
+{
+    char m_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) )); ///< The datagram received from the server
+    bool m_in_use;                                               ///< Whether a return value currently borrows from m_buffer
+};
+
+/** @struct
+
+    @brief Defines the client side state of a stream being consumed.
+*/
+struct rpc_stream_call
+{
+    int                m_socket_descriptor;                              ///< The socket the stream is received on, connected to the server once the first chunk arrives
+    struct sockaddr_in m_server_sockaddr_in;                             ///< The server socket the request was sent to
+    struct sockaddr_in m_stream_sockaddr_in;                             ///< The server socket sending the stream, learned from the first chunk
+    uint64_t           m_request_id;                                     ///< The ID of the request, which every chunk carries
+    bool               m_connected;                                      ///< Whether the first chunk has arrived and the socket is connected to its source
+    uint32_t           m_next_seq;                                       ///< The sequence number of the next expected chunk
+    bool               m_ended;                                          ///< Whether the last chunk has been received
+    bool               m_failed;                                         ///< Whether the stream was cut short by an error
+    char               m_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) )); ///< The most recently received chunk
+    char               m_inflated[BUFFER_SIZE] __attribute__(( aligned( 16 ) )); ///< The most recently received chunk, if it was compressed
+};
+
+/** @struct
+
+    @brief Defines a call waiting for its reply. It lives on the stack of the calling thread, which sleeps until
+           a receiver thread finds the reply, stores it in m_buffer and wakes it up.
+*/
+struct pending_call
+{
+    uint64_t             m_request_id;        ///< The ID of the request whose reply is awaited
+    struct sockaddr_in   m_server_sockaddr_in; ///< The server the request was sent to, which the reply must come from
+    uint32_t             m_state;             ///< A CALL_* value
+    int                  m_size;              ///< The size of the reply in bytes
+    char*                m_buffer;            ///< Receives the reply. Holds BUFFER_SIZE bytes.
+    struct pending_call* m_sp_next;           ///< The next call in the same bucket
+};
+
+/** @struct
+
+    @brief Defines a bucket of the table of pending calls, which is indexed by request ID.
+*/
+struct pending_call_bucket
+{
+    pthread_mutex_t      m_mutex;        ///< Protects m_sp_head
+    struct pending_call* m_sp_head;      ///< The calls of this bucket
+} __attribute__(( aligned( 64 ) ));
+
+/* Values of s_client_runtime_state */
+#define CLIENT_RUNTIME_STOPPED 0 /* not started in this process yet */
+#define CLIENT_RUNTIME_STARTED 1 /* the shared sockets and their receiver threads are running */
+#define CLIENT_RUNTIME_FAILED  2 /* could not be started */
+
+/* The UDP sockets every regular call is sent from, started on first use in each process. */
+static int s_client_sockets[CLIENT_SOCKET_COUNT];
+static pthread_mutex_t s_client_runtime_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_client_runtime_state = CLIENT_RUNTIME_STOPPED;
+static bool s_client_runtime_fork_handler_registered = false;
+
+/* The calls waiting for a reply, and the next shared socket handed to a thread. */
+static struct pending_call_bucket s_pending_calls[PENDING_CALL_BUCKETS];
+static unsigned int s_next_client_socket = 0;
+
+/* The shared socket the calling thread sends from, or -1 before its first call. */
+static __thread int s_client_socket_index = -1;
+
+/* A receiver thread's buffer for the datagram being demultiplexed. */
+static __thread char s_demux_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) ));
+
+/* The calling thread's pooled request buffer, and its compressed counterpart. */
+static __thread char s_send_buffer[BUFFER_SIZE];
+static __thread char s_deflate_buffer[BUFFER_SIZE];
+
+/* The calling thread's buffer for decompressed return values. */
+static __thread char s_inflate_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) ));
+
+/* The calling thread's pooled receive buffers. */
+static __thread struct recv_slot s_recv_pool[RECV_POOL_SLOTS];
+
+/* The last request ID handed out, and how often a request is sampled for tracing. */
+static uint32_t s_last_request_id = 0;
+static unsigned int s_trace_sample_every = 0;
+
+/**
+ * @brief Sets how often a request is marked as sampled in the server's trace.
+ *
+ * @param sample_every Every sample_every'th request is sampled, or none if 0.
+ */
+void rpc_set_trace_sample_rate( unsigned int sample_every )
+{
+    s_trace_sample_every = sample_every;
+}
+
+/**
+ * @brief Claims a free receive buffer from the calling thread's pool.
+ *
+ * @return A pointer to the claimed receive slot, or NULL if every slot is borrowed.
+ */
+static struct recv_slot* acquire_recv_slot()
+{
+    unsigned int idx; ///< An index for for loops.
+
+    for( idx = 0; idx < RECV_POOL_SLOTS; idx++ )
+    {
+        if( !s_recv_pool[idx].m_in_use )
+        {
+            s_recv_pool[idx].m_in_use = true;
+            return &s_recv_pool[idx];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Encodes a remote procedure call request into the calling thread's pooled send buffer. A large
+ *        enough request is compressed into s_deflate_buffer if that makes it smaller.
+ *
+ * @param flags          The RPC_FLAG_* values to be set in the request header.
+ * @param procedure_name The procedure name corresponding to the procedure to be invoked on the server.
+ * @param nparams        The number of variable arguments accepted by the remote procedure.
+ * @param var_arg_list   A variable number of arguments of structure var_arg.
+ * @param pp_request     Receives a pointer to the request to be sent.
+ * @param p_request_id   Receives the ID of the request, unless NULL.
+ *
+ * @return The number of bytes of the request, or -1 if the request does not fit.
+ */
+static int encode_request( uint32_t flags, const char* procedure_name, const int nparams, va_list var_arg_list, const char** pp_request, uint64_t* p_request_id )
+{
+    unsigned int idx;                                          ///< An index for for loops.
+    struct rpc_header s_rpc_header;                            ///< The header of the request.
+    struct var_arg s_var_arg;                                  ///< The current variable argument.
+    size_t procedure_name_length = strlen(procedure_name) + 1; ///< Stores the number of characters in procedure_name including terminating null character.
+    char* p_send_buffer_offset;                                ///< Pointer to the current value in s_send_buffer.
+    char* p_send_buffer_end = s_send_buffer + BUFFER_SIZE;     ///< Pointer to one past the end of s_send_buffer.
+    size_t send_buffer_remaining;                              ///< Stores the number of unused bytes left in s_send_buffer.
+    size_t prefix_size;                                        ///< The number of bytes of the request up to and including nparams.
+    size_t args_size;                                          ///< The number of bytes of the arguments.
+    int compressed_size = 0;                                   ///< The size of the compressed arguments, or 0 if they are sent uncompressed.
+    uint32_t request_id;                                       ///< The per-process sequence number of the request.
+
+    // Takes all the values for the remote procedure call and places them into the pooled send buffer.
+    if( sizeof( struct rpc_header ) + sizeof( size_t ) + procedure_name_length + sizeof( uint32_t ) > BUFFER_SIZE )
+    {
+        fprintf( stderr, "make_remote_call(): procedure name is too long.\n" );
+        return -1;
+    }
+
+    // Decompression is always supported, so every request lets the server compress its reply.
+    s_rpc_header.m_flags = flags | RPC_FLAG_ACCEPT_COMPRESSED;
+    s_rpc_header.m_seq = 0;
+
+    // Request IDs are unique within the process, and carry the process ID to tell clients apart in a trace.
+    request_id = __atomic_add_fetch( &s_last_request_id, 1, __ATOMIC_RELAXED );
+    s_rpc_header.m_request_id = ( ( uint64_t )getpid() << 32 ) | request_id;
+
+    if( p_request_id != NULL )
+    {
+        *p_request_id = s_rpc_header.m_request_id;
+    }
+
+    if( s_trace_sample_every > 0 && request_id % s_trace_sample_every == 0 )
+    {
+        s_rpc_header.m_flags |= RPC_FLAG_TRACE_SAMPLED;
+    }
+
+    p_send_buffer_offset = s_send_buffer;
+    memcpy( p_send_buffer_offset, &s_rpc_header, sizeof( struct rpc_header ) );
+    p_send_buffer_offset += sizeof( struct rpc_header );
+    memcpy( p_send_buffer_offset, &procedure_name_length, sizeof( size_t ) );
+    p_send_buffer_offset += sizeof( size_t );
+    memcpy( p_send_buffer_offset, procedure_name, procedure_name_length );
+    p_send_buffer_offset += procedure_name_length;
+    memcpy( p_send_buffer_offset, &nparams, sizeof( uint32_t ) );
+    p_send_buffer_offset += sizeof( uint32_t );
+    prefix_size = p_send_buffer_offset - s_send_buffer;
+
+    // Iterate over all variable arguments and encode each one directly into the send buffer.
+    for( idx = 0; idx < nparams; idx++ )
+    {
+        s_var_arg = va_arg( var_arg_list, struct var_arg );
+
+        send_buffer_remaining = p_send_buffer_end - p_send_buffer_offset;
+
+        if( send_buffer_remaining < sizeof( size_t ) || s_var_arg.m_arg_size > send_buffer_remaining - sizeof( size_t ) )
+        {
+            fprintf( stderr, "make_remote_call(): arguments do not fit in a %d byte request.\n", BUFFER_SIZE );
+            return -1;
+        }
+
+        memcpy( p_send_buffer_offset, &s_var_arg.m_arg_size, sizeof( size_t ) );
+        p_send_buffer_offset += sizeof( size_t );
+        memcpy( p_send_buffer_offset, s_var_arg.m_p_arg, s_var_arg.m_arg_size );
+        p_send_buffer_offset += s_var_arg.m_arg_size;
+    }
+
+    *pp_request = s_send_buffer;
+    args_size = p_send_buffer_offset - s_send_buffer - prefix_size;
+
+    // Compress the arguments of a large enough request, but only send them compressed if that makes the request
+    // smaller. The procedure name stays uncompressed, so the server can route the request before decompressing it.
+    if( rpc_compression_threshold >= 0 && args_size >= ( size_t )rpc_compression_threshold && args_size > sizeof( size_t ) + 1 )
+    {
+        compressed_size = rpc_compress( s_send_buffer + prefix_size, args_size, s_deflate_buffer + prefix_size + sizeof( size_t ), args_size - sizeof( size_t ) - 1 );
+    }
+
+    if( compressed_size > 0 )
+    {
+        s_rpc_header.m_flags |= RPC_FLAG_COMPRESSED;
+        memcpy( s_deflate_buffer, s_send_buffer, prefix_size );
+        memcpy( s_deflate_buffer, &s_rpc_header, sizeof( struct rpc_header ) );
+        memcpy( s_deflate_buffer + prefix_size, &args_size, sizeof( size_t ) );
+        *pp_request = s_deflate_buffer;
+        return prefix_size + sizeof( size_t ) + compressed_size;
+    }
+
+    return p_send_buffer_offset - s_send_buffer;
+}
+
+/**
+ * @brief Locates the return value or chunk in a reply datagram, decompressing it if needed.
+ *
+ * @param p_datagram       The reply datagram.
+ * @param datagram_size    The size of p_datagram in bytes.
+ * @param p_inflate_buffer Receives a compressed payload once decompressed. Must hold RPC_REPLY_CAPACITY bytes.
+ * @param pp_payload       Receives a pointer to the payload, either within p_datagram or p_inflate_buffer.
+ *
+ * @return The size of the payload in bytes, or -1 if the datagram is malformed.
+ */
+static int decode_reply_payload( const char* p_datagram, int datagram_size, char* p_inflate_buffer, const char** pp_payload )
+{
+    struct rpc_header s_rpc_header; ///< The header of the datagram.
+    size_t payload_size;            ///< The size of the payload once decompressed.
+
+    if( datagram_size < ( int )RPC_REPLY_PAYLOAD_OFFSET )
+    {
+        return -1;
+    }
+
+    memcpy( &s_rpc_header, p_datagram, sizeof( struct rpc_header ) );
+    memcpy( &payload_size, p_datagram + sizeof( struct rpc_header ), sizeof( size_t ) );
+    *pp_payload = p_datagram + RPC_REPLY_PAYLOAD_OFFSET;
+
+    if( !( s_rpc_header.m_flags & RPC_FLAG_COMPRESSED ) )
+    {
+        return payload_size <= ( size_t )( datagram_size - RPC_REPLY_PAYLOAD_OFFSET ) ? ( int )payload_size : -1;
+    }
+
+    if( payload_size > RPC_REPLY_CAPACITY || rpc_decompress( *pp_payload, datagram_size - RPC_REPLY_PAYLOAD_OFFSET, p_inflate_buffer, payload_size ) < 0 )
+    {
+        return -1;
+    }
+
+    *pp_payload = p_inflate_buffer;
+    return payload_size;
+}
+
+/**
+ * @brief Configures the address of the server.
+ *
+ * @param servernameorip        The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber      The port number corresponding to the server process.
+ * @param sp_server_sockaddr_in Receives the server socket address and port.
+ *
+ * @return Returns true if the address is valid.
+ */
+static bool resolve_server_address( const char* servernameorip, const int serverportnumber, struct sockaddr_in* sp_server_sockaddr_in )
+{
+    // Configure the server port number.
+    memset( ( void* )sp_server_sockaddr_in, 0, sizeof( *sp_server_sockaddr_in ) );
+    sp_server_sockaddr_in->sin_family = AF_INET;
+    sp_server_sockaddr_in->sin_port = htons( serverportnumber );
+
+    // Configure the server IPv4 address. If not able to set server IPv4 address, return NULL.
+    if( inet_aton( servernameorip, &sp_server_sockaddr_in->sin_addr ) == 0 )
+    {
+        perror( "inet_aton() failed!" );
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Establishes a UDP socket on the client and configures the address of the server.
+ *
+ * @param servernameorip        The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber      The port number corresponding to the server process.
+ * @param sp_server_sockaddr_in Receives the server socket address and port.
+ *
+ * @return The file descriptor of the established socket, or -1 on failure.
+ */
+static int open_client_socket( const char* servernameorip, const int serverportnumber, struct sockaddr_in* sp_server_sockaddr_in )
+{
+    int socket_descriptor;                     ///< Stores the file descriptor pertaining to the established socket.
+    struct sockaddr_in sp_client_sockaddr_in;  ///< Stores the client socket address and port.
+
+    // Establish a UDP socket on the client.
+    socket_descriptor = socket(AF_INET, SOCK_DGRAM, 0);
+
+    // Check if socket was established successfully. If not, return NULL.
+    if( socket_descriptor < 0 )
+    {
+        perror( "Could not create socket." );
+        return -1;
+    }
+
+    // Configure the client socket address and port number. Client can accept responses on all network interfaces.
+    memset( ( char* )&sp_client_sockaddr_in, 0, sizeof( sp_client_sockaddr_in ) );
+    sp_client_sockaddr_in.sin_family = AF_INET;
+    sp_client_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
+    sp_client_sockaddr_in.sin_port = htons( 0 );
+
+    // Bind address and port number to UDP socket. If bind unsuccessful, return NULL.
+    if( bind( socket_descriptor, ( struct sockaddr* )&sp_client_sockaddr_in, sizeof( sp_client_sockaddr_in ) ) < 0 )
+    {
+        perror( "Could not bind client address to socket." );
+        close( socket_descriptor );
+        return -1;
+    }
+
+    if( !resolve_server_address( servernameorip, serverportnumber, sp_server_sockaddr_in ) )
+    {
+        close( socket_descriptor );
+        return -1;
+    }
+
+    return socket_descriptor;
+}
+
+/**
+ * @brief Adds a call to the table of calls waiting for a reply.
+ *
+ * @param sp_pending_call The call to be added.
+ */
+static void add_pending_call( struct pending_call* sp_pending_call )
+{
+    struct pending_call_bucket* sp_bucket = &s_pending_calls[sp_pending_call->m_request_id & ( PENDING_CALL_BUCKETS - 1 )]; ///< The bucket of the call.
+
+    pthread_mutex_lock( &sp_bucket->m_mutex );
+    sp_pending_call->m_sp_next = sp_bucket->m_sp_head;
+    sp_bucket->m_sp_head = sp_pending_call;
+    pthread_mutex_unlock( &sp_bucket->m_mutex );
+}
+
+/**
+ * @brief Removes the call waiting for a reply to a request from the table of pending calls.
+ *
+ * @param request_id  The ID of the request.
+ * @param sp_source   The address the reply came from. The call is only removed if it was sent to this address.
+ *                    NULL removes the call wherever it was sent.
+ *
+ * @return The removed call, or NULL if no call to sp_source waits for a reply to the request.
+ */
+static struct pending_call* remove_pending_call( uint64_t request_id, const struct sockaddr_in* sp_source )
+{
+    struct pending_call_bucket* sp_bucket = &s_pending_calls[request_id & ( PENDING_CALL_BUCKETS - 1 )]; ///< The bucket of the call.
+    struct pending_call** psp_link;                                                                     ///< The link pointing at the current call.
+    struct pending_call* sp_pending_call = NULL;                                                        ///< The removed call.
+
+    pthread_mutex_lock( &sp_bucket->m_mutex );
+
+    for( psp_link = &sp_bucket->m_sp_head; *psp_link != NULL; psp_link = &( *psp_link )->m_sp_next )
+    {
+        if( ( *psp_link )->m_request_id == request_id &&
+            ( sp_source == NULL || ( ( *psp_link )->m_server_sockaddr_in.sin_addr.s_addr == sp_source->sin_addr.s_addr &&
+                                     ( *psp_link )->m_server_sockaddr_in.sin_port == sp_source->sin_port ) ) )
+        {
+            sp_pending_call = *psp_link;
+            *psp_link = sp_pending_call->m_sp_next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &sp_bucket->m_mutex );
+
+    return sp_pending_call;
+}
+
+/**
+ * @brief Sleeps until a receiver thread has stored the reply of a pending call, for at most RPC_CALL_TIMEOUT_SEC.
+ *
+ * @param sp_pending_call The call whose reply is awaited.
+ *
+ * @return Returns true if the reply was stored. Returns false if the call timed out and has been removed from the
+ *         table of pending calls.
+ */
+static bool wait_for_reply( struct pending_call* sp_pending_call )
+{
+    uint32_t state = CALL_WAITING; ///< The state the call is expected to be in.
+    struct timespec s_deadline;    ///< When the call times out.
+    struct timespec s_now;         ///< The current time.
+    struct timespec s_timeout;     ///< The time left until s_deadline.
+
+    // Announce the sleep, unless the reply has already arrived.
+    if( !__atomic_compare_exchange_n( &sp_pending_call->m_state, &state, CALL_SLEEPING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE ) )
+    {
+        return true;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &s_deadline );
+    s_deadline.tv_sec += RPC_CALL_TIMEOUT_SEC;
+
+    while( __atomic_load_n( &sp_pending_call->m_state, __ATOMIC_ACQUIRE ) != CALL_REPLIED )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &s_now );
+        s_timeout.tv_sec = s_deadline.tv_sec - s_now.tv_sec;
+        s_timeout.tv_nsec = s_deadline.tv_nsec - s_now.tv_nsec;
+
+        if( s_timeout.tv_nsec < 0 )
+        {
+            s_timeout.tv_sec--;
+            s_timeout.tv_nsec += 1000000000L;
+        }
+
+        if( s_timeout.tv_sec < 0 )
+        {
+            // Give up, unless a receiver thread has already claimed the call and is storing its reply.
+            if( remove_pending_call( sp_pending_call->m_request_id, NULL ) == sp_pending_call )
+            {
+                return false;
+            }
+
+            while( __atomic_load_n( &sp_pending_call->m_state, __ATOMIC_ACQUIRE ) != CALL_REPLIED )
+            {
+                syscall( SYS_futex, &sp_pending_call->m_state, FUTEX_WAIT_PRIVATE, CALL_SLEEPING, NULL, NULL, 0 );
+            }
+
+            return true;
+        }
+
+        syscall( SYS_futex, &sp_pending_call->m_state, FUTEX_WAIT_PRIVATE, CALL_SLEEPING, &s_timeout, NULL, 0 );
+    }
+
+    return true;
+}
+
+/**
+ * @brief This function is the body of a receiver thread. It receives the replies arriving on one shared socket
+ *        forever, and hands each of them to the call waiting for it.
+ *
+ * @param p_socket_descriptor The shared socket, cast to a pointer.
+ *
+ * @return Never returns.
+ */
+static void* client_receiver_main( void* p_socket_descriptor )
+{
+    int socket_descriptor = ( int )( intptr_t )p_socket_descriptor; ///< The shared socket.
+    int recv_size_bytes;                                            ///< Stores the number of bytes received from the server.
+    struct sockaddr_in s_source_sockaddr_in;                        ///< The address the reply came from.
+    socklen_t addrlen;                                              ///< Stores the length of s_source_sockaddr_in.
+    struct rpc_header s_rpc_header;                                 ///< The header of the reply.
+    struct pending_call* sp_pending_call;                           ///< The call waiting for the reply.
+
+    while( true )
+    {
+        addrlen = sizeof( s_source_sockaddr_in );
+        recv_size_bytes = recvfrom( socket_descriptor, s_demux_buffer, BUFFER_SIZE, 0, ( struct sockaddr* )&s_source_sockaddr_in, &addrlen );
+
+        if( recv_size_bytes < ( int )sizeof( struct rpc_header ) )
+        {
+            continue;
+        }
+
+        // A reply nobody waits for any more is dropped, and so is a datagram from anywhere but the server the
+        // request was sent to, since any host can send to the shared sockets.
+        memcpy( &s_rpc_header, s_demux_buffer, sizeof( struct rpc_header ) );
+        sp_pending_call = remove_pending_call( s_rpc_header.m_request_id, &s_source_sockaddr_in );
+
+        if( sp_pending_call == NULL )
+        {
+            continue;
+        }
+
+        // The calling thread may return as soon as it sees CALL_REPLIED, so the call is not touched after that.
+        memcpy( sp_pending_call->m_buffer, s_demux_buffer, recv_size_bytes );
+        sp_pending_call->m_size = recv_size_bytes;
+
+        if( __atomic_exchange_n( &sp_pending_call->m_state, CALL_REPLIED, __ATOMIC_RELEASE ) == CALL_SLEEPING )
+        {
+            syscall( SYS_futex, &sp_pending_call->m_state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0 );
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Resets the client runtime in a forked child. The child has none of the receiver threads, and must not
+ *        share the parent's sockets, since either process could receive the other's replies. Its first call
+ *        starts a runtime of its own.
+ */
+static void reset_client_runtime_in_child()
+{
+    unsigned int idx; ///< An index for for loops.
+
+    if( s_client_runtime_state == CLIENT_RUNTIME_STARTED )
+    {
+        for( idx = 0; idx < CLIENT_SOCKET_COUNT; idx++ )
+        {
+            close( s_client_sockets[idx] );
+        }
+    }
+
+    // Other threads of the parent may have held these locks, or had calls pending, when it forked.
+    for( idx = 0; idx < PENDING_CALL_BUCKETS; idx++ )
+    {
+        pthread_mutex_init( &s_pending_calls[idx].m_mutex, NULL );
+        s_pending_calls[idx].m_sp_head = NULL;
+    }
+
+    pthread_mutex_init( &s_client_runtime_mutex, NULL );
+    s_client_runtime_state = CLIENT_RUNTIME_STOPPED;
+}
+
+/**
+ * @brief Opens the shared sockets and starts their receiver threads. Runs once per process, with
+ *        s_client_runtime_mutex held.
+ */
+static void start_client_runtime()
+{
+    unsigned int idx;                          ///< An index for for loops.
+    int receive_buffer_size = CLIENT_SOCKET_RCVBUF; ///< The receive buffer requested for each shared socket.
+    struct sockaddr_in s_client_sockaddr_in;   ///< Stores the client socket address and port.
+    sigset_t s_signal_set;                     ///< Every signal, which the receiver threads leave to the application.
+    sigset_t s_old_signal_set;                 ///< The signal mask of the calling thread.
+    pthread_t thread;                          ///< A receiver thread.
+
+    s_client_runtime_state = CLIENT_RUNTIME_FAILED;
+
+    // The handler is inherited across fork(), so it is only registered by the first process to start a runtime.
+    if( !s_client_runtime_fork_handler_registered )
+    {
+        for( idx = 0; idx < PENDING_CALL_BUCKETS; idx++ )
+        {
+            pthread_mutex_init( &s_pending_calls[idx].m_mutex, NULL );
+            s_pending_calls[idx].m_sp_head = NULL;
+        }
+
+        s_client_runtime_fork_handler_registered = pthread_atfork( NULL, NULL, reset_client_runtime_in_child ) == 0;
+    }
+
+    memset( ( char* )&s_client_sockaddr_in, 0, sizeof( s_client_sockaddr_in ) );
+    s_client_sockaddr_in.sin_family = AF_INET;
+    s_client_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
+    s_client_sockaddr_in.sin_port = htons( 0 );
+
+    for( idx = 0; idx < CLIENT_SOCKET_COUNT; idx++ )
+    {
+        s_client_sockets[idx] = socket( AF_INET, SOCK_DGRAM, 0 );
+
+        if( s_client_sockets[idx] < 0 || bind( s_client_sockets[idx], ( struct sockaddr* )&s_client_sockaddr_in, sizeof( s_client_sockaddr_in ) ) < 0 )
+        {
+            perror( "Could not create client socket." );
+            return;
+        }
+
+        setsockopt( s_client_sockets[idx], SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof( receive_buffer_size ) );
+    }
+
+    // The receiver threads block every signal, so signals keep going to the application's threads.
+    sigfillset( &s_signal_set );
+    pthread_sigmask( SIG_BLOCK, &s_signal_set, &s_old_signal_set );
+
+    for( idx = 0; idx < CLIENT_SOCKET_COUNT; idx++ )
+    {
+        if( pthread_create( &thread, NULL, client_receiver_main, ( void* )( intptr_t )s_client_sockets[idx] ) != 0 )
+        {
+            perror( "Could not start client receiver thread." );
+            pthread_sigmask( SIG_SETMASK, &s_old_signal_set, NULL );
+            return;
+        }
+
+        pthread_detach( thread );
+    }
+
+    pthread_sigmask( SIG_SETMASK, &s_old_signal_set, NULL );
+    __atomic_store_n( &s_client_runtime_state, CLIENT_RUNTIME_STARTED, __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief Returns the shared socket the calling thread sends its calls from, starting the client runtime on first use
+ *        in this process. Threads are spread over the shared sockets round robin.
+ *
+ * @return The socket, or -1 if the client runtime could not be started.
+ */
+static int client_socket()
+{
+    if( __atomic_load_n( &s_client_runtime_state, __ATOMIC_ACQUIRE ) != CLIENT_RUNTIME_STARTED )
+    {
+        pthread_mutex_lock( &s_client_runtime_mutex );
+
+        if( s_client_runtime_state == CLIENT_RUNTIME_STOPPED )
+        {
+            start_client_runtime();
+        }
+
+        pthread_mutex_unlock( &s_client_runtime_mutex );
+
+        if( __atomic_load_n( &s_client_runtime_state, __ATOMIC_ACQUIRE ) != CLIENT_RUNTIME_STARTED )
+        {
+            return -1;
+        }
+    }
+
+    if( s_client_socket_index < 0 )
+    {
+        s_client_socket_index = __atomic_fetch_add( &s_next_client_socket, 1, __ATOMIC_RELAXED ) % CLIENT_SOCKET_COUNT;
+    }
+
+    return s_client_sockets[s_client_socket_index];
+}
+
 /**
  * @brief Invokes a remote procedure on the server.
  *
@@ -29,136 +665,114 @@ struct var_arg
  * @param serverportnumber The port number corresponding to the server process.
  * @param procedure_name   The procedure name corresponding to the procedure to be invoked on the server.
  * @param nparams          The number of variable arguments accepted by the remote procedure.
- * @param ...              A variable number of arguments of structure var_arg.
+ * @param borrow           If true, the return value borrows from a pooled receive buffer instead of being allocated.
+ * @param var_arg_list     A variable number of arguments of structure var_arg.
  *
  * @return The return value corresponding to the the remote procedure.
  */
-return_type make_remote_call(const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, ... )
+static return_type make_remote_call_v( const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, bool borrow, va_list var_arg_list )
 {
     int socket_descriptor;                                     ///< Stores the file descriptor pertaining to the established socket.
-    unsigned int idx;                                          ///< An index for for loops.
-    unsigned int var_arg_list_size = 0;                        ///< Stores the number of variable arguments.     
+    int send_size_bytes;                                       ///< Stores the number of bytes of the request.
+    int recv_size_bytes;                                       ///< Stores the number of bytes received from the server.
+    const char* p_request;                                     ///< The encoded request.
+    const char* p_payload;                                     ///< The return value within the reply, once decompressed.
     struct sockaddr_in sp_server_sockaddr_in;                  ///< Stores the server socket address and port.
-    struct sockaddr_in sp_client_sockaddr_in;                  ///< Stores the client socket address and port.
-    struct var_arg* sp_var_arg_array;                          ///< An array that stores the variable arguments for the remote procedure call.
-    struct var_arg s_var_arg;                                  ///< The current variable argument in the variable argument array.
     socklen_t addrlen = sizeof(sp_server_sockaddr_in);         ///< Stores the length of sp_server_sockaddr_in.
     return_type s_return_type;                                 ///< Stores the return value pertaining to the remote procedure call.
-    size_t procedure_name_length = strlen(procedure_name) + 1; ///< Stores the number of characters in procedure_name including terminating null character.
-    va_list var_arg_list;                                      ///< Stores a list of unconstrained arguments.
-    void* p_send_buffer;                                       ///< Buffer containing remote procedure call arguments to be sent to the server.
-    void* p_send_buffer_offset;                                ///< Pointer to the current value in p_send_buffer. 
-    void* p_recv_buffer;                                       ///< Buffer containing return value to be received from the server.
-    void* p_recv_buffer_offset;                                ///< Pointer to the current value in p_recv_buffer.
-    size_t p_send_buffer_size;                                 ///< Defines the size of the buffer in bytes to be sent to the server.
-    
-    // Establish a UDP socket on the client.
-    socket_descriptor = socket(AF_INET, SOCK_DGRAM, 0);
+    struct recv_slot* sp_recv_slot;                            ///< The pooled buffer the server response is received into.
+    struct recv_slot s_fallback_slot;                          ///< Receive buffer used when every pooled buffer is borrowed.
+    struct pending_call s_pending_call;                        ///< The call as seen by the receiver threads.
 
-    // Check if socket was established successfully. If not, return NULL.
-    if( socket_descriptor < 0 )
-    {
-        perror( "Could not create socket." );
-        s_return_type.return_size = 0;
-        s_return_type.return_val = NULL;
-        return s_return_type;
-    }
+    s_return_type.return_size = 0;
+    s_return_type.return_val = NULL;
 
-    // Configure the client socket address and port number. Client can accept responses on all network interfaces.
-    memset( ( char* )&sp_client_sockaddr_in, 0, sizeof( sp_client_sockaddr_in ) );
-    sp_client_sockaddr_in.sin_family = AF_INET;
-    sp_client_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
-    sp_client_sockaddr_in.sin_port = htons( 0 );
+    // Takes all the values for the remote procedure call and places them into the pooled send buffer.
+    send_size_bytes = encode_request( 0, procedure_name, nparams, var_arg_list, &p_request, &s_pending_call.m_request_id );
 
-    // Bind address and port number to UDP socket. If bind unsuccessful, return NULL.
-    if( bind( socket_descriptor, ( struct sockaddr* )&sp_client_sockaddr_in, sizeof( sp_client_sockaddr_in ) ) < 0 )
+    if( send_size_bytes < 0 )
     {
-        perror( "Could not bind client address to socket." );
-        s_return_type.return_size = 0;
-        s_return_type.return_val = NULL;
         return s_return_type;
     }
-    
-    // Configure the server port number.
-    memset( ( void* )&sp_server_sockaddr_in, 0, sizeof( sp_server_sockaddr_in ) );
-    sp_server_sockaddr_in.sin_family = AF_INET;
-    sp_server_sockaddr_in.sin_port = htons( serverportnumber );
 
-    // Configure the server IPv4 address. If not able to set server IPv4 address, return NULL.
-    if( inet_aton( servernameorip, &sp_server_sockaddr_in.sin_addr ) == 0 )
+    // Every thread sends from one of the process wide sockets, instead of opening a socket per call.
+    socket_descriptor = client_socket();
+
+    if( socket_descriptor < 0 || !resolve_server_address( servernameorip, serverportnumber, &sp_server_sockaddr_in ) )
     {
-        perror( "inet_aton() failed!" );
-        s_return_type.return_size = 0;
-        s_return_type.return_val = NULL;
         return s_return_type;
     }
-    
-    // Allocate memory for the variable argument array.
-    sp_var_arg_array = ( struct var_arg* )malloc( sizeof( struct var_arg ) * nparams );
 
-    // Start reading in variable arguments.
-    va_start( var_arg_list, nparams );
-    
-    // Iterate over all variable arguments and store in variable argument array.
-    for( idx = 0; idx < nparams; idx++ )
+    // Receive into a pooled buffer. Only a borrowed return value needs to keep its slot past this call.
+    sp_recv_slot = acquire_recv_slot();
+
+    if( sp_recv_slot == NULL )
     {
-        s_var_arg = va_arg( var_arg_list, struct var_arg );
-        var_arg_list_size += s_var_arg.m_arg_size;
-        sp_var_arg_array[idx] = s_var_arg;
+        sp_recv_slot = &s_fallback_slot;
     }
-    
-    // Stop reading in variable arguments.
-    va_end( var_arg_list );
 
-    // Takes all the values for the remote procedure call and places them into p_send_buffer.
-    p_send_buffer_size = sizeof( size_t ) + strlen( procedure_name ) + 1  + sizeof( uint32_t ) + var_arg_list_size + ( sizeof( size_t ) * nparams );
-    p_send_buffer = malloc( p_send_buffer_size );
-    p_send_buffer_offset = p_send_buffer;
-    memcpy( p_send_buffer_offset, &procedure_name_length, sizeof( size_t ) );
-    p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + sizeof( size_t ) );
-    strcpy( ( char* )p_send_buffer_offset, procedure_name );
-    p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + procedure_name_length );
-    memcpy( p_send_buffer_offset, &nparams, sizeof( uint32_t ) );
-    p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + sizeof( uint32_t ) );
+    // Wait for the reply before the request is sent, so a receiver thread can never miss it.
+    s_pending_call.m_server_sockaddr_in = sp_server_sockaddr_in;
+    s_pending_call.m_state = CALL_WAITING;
+    s_pending_call.m_size = 0;
+    s_pending_call.m_buffer = sp_recv_slot->m_buffer;
+    add_pending_call( &s_pending_call );
 
-    for( idx = 0; idx < nparams; idx++ )
+    // Send values in the send buffer to the server. If send fails, return NULL.
+    if( sendto( socket_descriptor, p_request, send_size_bytes, 0, ( struct sockaddr* )&sp_server_sockaddr_in, addrlen) < 0 )
     {
-        memcpy( p_send_buffer_offset, &(sp_var_arg_array[idx].m_arg_size), sizeof( size_t ) );
-        p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + sizeof( size_t ) );
-        memcpy( p_send_buffer_offset, sp_var_arg_array[idx].m_p_arg, sp_var_arg_array[idx].m_arg_size );
-        p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + sp_var_arg_array[idx].m_arg_size );
+        perror( "Failed to send packet to server." );
+
+        // A receiver thread may have claimed the call already, in which case the reply must be waited for.
+        if( remove_pending_call( s_pending_call.m_request_id, NULL ) != &s_pending_call )
+        {
+            wait_for_reply( &s_pending_call );
+        }
+
+        sp_recv_slot->m_in_use = false;
+        return s_return_type;
     }
 
-    // Send values in p_send_buffer to the server. If send fails, return NULL.
-    if( sendto( socket_descriptor, p_send_buffer, p_send_buffer_size, 0, ( struct sockaddr* )&sp_server_sockaddr_in, addrlen) < 0 )
+    // Sleep until a receiver thread has stored the reply in the pooled buffer. A late reply is dropped.
+    if( !wait_for_reply( &s_pending_call ) )
     {
-        perror( "Failed to send packet to server." );
-        s_return_type.return_size = 0;
-        s_return_type.return_val = NULL;
+        fprintf( stderr, "make_remote_call(): no reply within %d seconds.\n", RPC_CALL_TIMEOUT_SEC );
+        sp_recv_slot->m_in_use = false;
         return s_return_type;
     }
 
-    // Allocate memory on the heap for p_recv_buffer.
-    p_recv_buffer = malloc( BUFFER_SIZE );
+    recv_size_bytes = s_pending_call.m_size;
 
-    // Attempt to receive response from server.
-    if( recvfrom( socket_descriptor, p_recv_buffer, BUFFER_SIZE, 0, ( struct sockaddr* )&sp_client_sockaddr_in, &addrlen ) >= 0 )
+    if( recv_size_bytes >= 0 )
     {
         // If response received successfully, read in return value from server and return it to calling function.
-        p_recv_buffer_offset = p_recv_buffer;
-        s_return_type.return_size = *( size_t* )p_recv_buffer_offset;
-        p_recv_buffer_offset = ( void* )( ( char* )p_recv_buffer_offset + sizeof( size_t ) );
+        s_return_type.return_size = decode_reply_payload( sp_recv_slot->m_buffer, recv_size_bytes, s_inflate_buffer, &p_payload );
 
         if( s_return_type.return_size > 0 )
         {
-            s_return_type.return_val = malloc(s_return_type.return_size);
-            memcpy( s_return_type.return_val, p_recv_buffer_offset, s_return_type.return_size );
+            if( borrow && sp_recv_slot != &s_fallback_slot )
+            {
+                // Hand out the pooled buffer itself. release_return_value() returns it to the pool.
+                s_return_type.return_val = sp_recv_slot->m_buffer + RPC_REPLY_PAYLOAD_OFFSET;
+                sp_recv_slot = NULL;
+
+                // A decompressed return value is moved back into the pooled buffer.
+                if( p_payload != s_return_type.return_val )
+                {
+                    memcpy( s_return_type.return_val, p_payload, s_return_type.return_size );
+                }
+            }
+            else
+            {
+                s_return_type.return_val = malloc( s_return_type.return_size );
+                memcpy( s_return_type.return_val, p_payload, s_return_type.return_size );
+            }
         }
         else
         {
             s_return_type.return_size = 0;
             s_return_type.return_val = NULL;
-        } 
+        }
     }
     else
     {
@@ -168,18 +782,379 @@ return_type make_remote_call(const char* servernameorip, const int serverportnum
         s_return_type.return_val = NULL;
     }
 
-    // Close the client socket.
-    close( socket_descriptor );
+    // Return the receive buffer to the pool unless the return value borrows from it.
+    if( sp_recv_slot != NULL )
+    {
+        sp_recv_slot->m_in_use = false;
+    }
 
-    // Deallocate memory for sp_var_arg_array.
-    free( sp_var_arg_array );
-    
-    // Deallocate memory for p_send_buffer.
-    free( p_send_buffer );
-    
-    // Deallocate memory for p_recv_buffer.
-    free( p_recv_buffer );
-    
     // Return RPC return value to calling function.
     return s_return_type;
 }
+
+/**
+ * @brief Invokes a remote procedure on the server.
+ *
+ * @param servernameorip   The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber The port number corresponding to the server process.
+ * @param procedure_name   The procedure name corresponding to the procedure to be invoked on the server.
+ * @param nparams          The number of variable arguments accepted by the remote procedure.
+ * @param ...              A variable number of arguments of structure var_arg.
+ *
+ * @return The return value corresponding to the the remote procedure. The caller owns return_val.
+ */
+return_type make_remote_call(const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, ... )
+{
+    return_type s_return_type; ///< Stores the return value pertaining to the remote procedure call.
+    va_list var_arg_list;      ///< Stores a list of unconstrained arguments.
+
+    va_start( var_arg_list, nparams );
+    s_return_type = make_remote_call_v( servernameorip, serverportnumber, procedure_name, nparams, false, var_arg_list );
+    va_end( var_arg_list );
+
+    return s_return_type;
+}
+
+/**
+ * @brief Invokes a remote procedure on the server without allocating the return value.
+ *
+ * @param servernameorip   The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber The port number corresponding to the server process.
+ * @param procedure_name   The procedure name corresponding to the procedure to be invoked on the server.
+ * @param nparams          The number of variable arguments accepted by the remote procedure.
+ * @param ...              A variable number of arguments of structure var_arg.
+ *
+ * @return The return value corresponding to the the remote procedure. return_val borrows from a pooled
+ *         receive buffer and must be handed back with release_return_value().
+ */
+return_type make_remote_call_borrowed(const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, ... )
+{
+    return_type s_return_type; ///< Stores the return value pertaining to the remote procedure call.
+    va_list var_arg_list;      ///< Stores a list of unconstrained arguments.
+
+    va_start( var_arg_list, nparams );
+    s_return_type = make_remote_call_v( servernameorip, serverportnumber, procedure_name, nparams, true, var_arg_list );
+    va_end( var_arg_list );
+
+    return s_return_type;
+}
+
+/**
+ * @brief Releases a return value obtained from make_remote_call_borrowed().
+ *
+ * @param p_return_type The return value to be released. It is reset to an empty return value.
+ */
+void release_return_value( return_type* p_return_type )
+{
+    unsigned int idx; ///< An index for for loops.
+
+    if( p_return_type == NULL || p_return_type->return_val == NULL )
+    {
+        return;
+    }
+
+    // If the return value borrows from a pooled receive buffer, give the buffer back to the pool.
+    for( idx = 0; idx < RECV_POOL_SLOTS; idx++ )
+    {
+        if( p_return_type->return_val == s_recv_pool[idx].m_buffer + RPC_REPLY_PAYLOAD_OFFSET )
+        {
+            s_recv_pool[idx].m_in_use = false;
+            break;
+        }
+    }
+
+    // Otherwise every pooled buffer was borrowed and the return value was allocated instead.
+    if( idx == RECV_POOL_SLOTS )
+    {
+        free( p_return_type->return_val );
+    }
+
+    p_return_type->return_val = NULL;
+    p_return_type->return_size = 0;
+}
+
+/**
+ * @brief Grants the server credit for every chunk up to RPC_STREAM_WINDOW chunks past the last completed
+ *        RPC_STREAM_CREDIT_BATCH. Credits are cumulative, so granting the same credit again is harmless.
+ *
+ * @param p_stream_call The stream being consumed.
+ */
+static void send_stream_credit( rpc_stream_call* p_stream_call )
+{
+    struct rpc_header s_rpc_header; ///< The credit.
+
+    s_rpc_header.m_flags = RPC_FLAG_STREAM_CREDIT;
+    s_rpc_header.m_seq = p_stream_call->m_next_seq - p_stream_call->m_next_seq % RPC_STREAM_CREDIT_BATCH + RPC_STREAM_WINDOW;
+    s_rpc_header.m_request_id = p_stream_call->m_request_id;
+
+    if( send( p_stream_call->m_socket_descriptor, &s_rpc_header, sizeof( s_rpc_header ), 0 ) < 0 )
+    {
+        perror( "Could not grant stream credit to server." );
+    }
+}
+
+/**
+ * @brief Invokes a streaming procedure on the server.
+ *
+ * @param servernameorip   The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber The port number corresponding to the server process.
+ * @param procedure_name   The procedure name corresponding to the streaming procedure to be invoked on the server.
+ * @param nparams          The number of variable arguments accepted by the remote procedure.
+ * @param var_arg_list     A variable number of arguments of structure var_arg.
+ *
+ * @return A handle from which the stream is read, or NULL on failure.
+ */
+static rpc_stream_call* open_stream_call_v( const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, va_list var_arg_list )
+{
+    int send_size_bytes;                                     ///< Stores the number of bytes of the request.
+    const char* p_request;                                   ///< The encoded request.
+    struct sockaddr_in sp_server_sockaddr_in;                ///< Stores the server socket address and port.
+    struct timeval s_timeout;                                ///< How long to wait for the next chunk before granting credit again.
+    rpc_stream_call* sp_stream_call;                         ///< The handle to be returned.
+    uint64_t request_id;                                     ///< The ID of the request.
+
+    send_size_bytes = encode_request( RPC_FLAG_STREAM, procedure_name, nparams, var_arg_list, &p_request, &request_id );
+
+    if( send_size_bytes < 0 )
+    {
+        return NULL;
+    }
+
+    sp_stream_call = ( rpc_stream_call* )malloc( sizeof( rpc_stream_call ) );
+
+    if( sp_stream_call == NULL )
+    {
+        return NULL;
+    }
+
+    sp_stream_call->m_socket_descriptor = open_client_socket( servernameorip, serverportnumber, &sp_server_sockaddr_in );
+    sp_stream_call->m_server_sockaddr_in = sp_server_sockaddr_in;
+    sp_stream_call->m_request_id = request_id;
+    sp_stream_call->m_connected = false;
+    sp_stream_call->m_next_seq = 0;
+    sp_stream_call->m_ended = false;
+    sp_stream_call->m_failed = false;
+
+    if( sp_stream_call->m_socket_descriptor < 0 )
+    {
+        free( sp_stream_call );
+        return NULL;
+    }
+
+    // Wake up regularly while waiting for a chunk, so a lost credit can be granted again.
+    s_timeout.tv_sec = RPC_STREAM_RETRY_MS / 1000;
+    s_timeout.tv_usec = ( RPC_STREAM_RETRY_MS % 1000 ) * 1000;
+    setsockopt( sp_stream_call->m_socket_descriptor, SOL_SOCKET, SO_RCVTIMEO, &s_timeout, sizeof( s_timeout ) );
+
+    if( sendto( sp_stream_call->m_socket_descriptor, p_request, send_size_bytes, 0, ( struct sockaddr* )&sp_server_sockaddr_in, sizeof( sp_server_sockaddr_in ) ) < 0 )
+    {
+        perror( "Failed to send packet to server." );
+        close( sp_stream_call->m_socket_descriptor );
+        free( sp_stream_call );
+        return NULL;
+    }
+
+    return sp_stream_call;
+}
+
+/**
+ * @brief Invokes a streaming procedure on the server.
+ *
+ * @param servernameorip   The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber The port number corresponding to the server process.
+ * @param procedure_name   The procedure name corresponding to the streaming procedure to be invoked on the server.
+ * @param nparams          The number of variable arguments accepted by the remote procedure.
+ * @param ...              A variable number of arguments of structure var_arg.
+ *
+ * @return A handle from which the stream is read with next_stream_chunk(), or NULL on failure.
+ */
+rpc_stream_call* open_stream_call( const char* servernameorip, const int serverportnumber, const char* procedure_name, const int nparams, ... )
+{
+    rpc_stream_call* sp_stream_call; ///< The handle to be returned.
+    va_list var_arg_list;            ///< Stores a list of unconstrained arguments.
+
+    va_start( var_arg_list, nparams );
+    sp_stream_call = open_stream_call_v( servernameorip, serverportnumber, procedure_name, nparams, var_arg_list );
+    va_end( var_arg_list );
+
+    return sp_stream_call;
+}
+
+/**
+ * @brief Receives the next chunk of a stream.
+ *
+ * @param p_stream_call The stream being consumed.
+ * @param p_chunk       Receives the chunk. return_val is only valid until the next call.
+ *
+ * @return Returns true if a chunk was received. Returns false once the stream has ended or failed.
+ */
+bool next_stream_chunk( rpc_stream_call* p_stream_call, return_type* p_chunk )
+{
+    int recv_size_bytes;                                 ///< Stores the number of bytes received from the server.
+    socklen_t addrlen;                                   ///< Stores the length of s_source_sockaddr_in.
+    struct sockaddr_in s_source_sockaddr_in;             ///< The socket the received datagram came from.
+    struct rpc_header s_rpc_header;                      ///< The header of the received chunk.
+    int chunk_size;                                      ///< The size of the received chunk.
+    const char* p_payload;                               ///< The received chunk, once decompressed.
+    int waited_ms = 0;                                   ///< How long the next chunk has been waited for.
+    bool server_gone = false;                            ///< Whether the server socket has closed, so only chunks already queued remain.
+
+    p_chunk->return_val = NULL;
+    p_chunk->return_size = 0;
+
+    while( !p_stream_call->m_ended && !p_stream_call->m_failed )
+    {
+        // Every RPC_STREAM_CREDIT_BATCH consumed chunks, allow the server to run further ahead.
+        if( p_stream_call->m_next_seq > 0 && p_stream_call->m_next_seq % RPC_STREAM_CREDIT_BATCH == 0 && waited_ms == 0 && !server_gone )
+        {
+            send_stream_credit( p_stream_call );
+        }
+
+        addrlen = sizeof( s_source_sockaddr_in );
+        recv_size_bytes = recvfrom( p_stream_call->m_socket_descriptor, p_stream_call->m_buffer, BUFFER_SIZE, server_gone ? MSG_DONTWAIT : 0, ( struct sockaddr* )&s_source_sockaddr_in, &addrlen );
+
+        // The server closes its stream socket right after the last chunk, so a credit sent meanwhile is refused.
+        // The kernel reports that ahead of the chunks still queued, which are read before giving up.
+        if( recv_size_bytes < 0 && errno == ECONNREFUSED )
+        {
+            server_gone = true;
+            continue;
+        }
+
+        if( recv_size_bytes < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if( recv_size_bytes < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) && !server_gone && waited_ms < RPC_STREAM_TIMEOUT_SEC * 1000 )
+        {
+            // The last credit may have been lost, in which case both sides would wait for each other. Grant it again.
+            waited_ms += RPC_STREAM_RETRY_MS;
+
+            if( p_stream_call->m_connected )
+            {
+                send_stream_credit( p_stream_call );
+            }
+
+            continue;
+        }
+
+        if( recv_size_bytes < ( int )RPC_REPLY_PAYLOAD_OFFSET )
+        {
+            perror( "Could not receive stream chunk from server." );
+            p_stream_call->m_failed = true;
+            break;
+        }
+
+        memcpy( &s_rpc_header, p_stream_call->m_buffer, sizeof( s_rpc_header ) );
+
+        // Only chunks of this stream from the server count. The first one tells which server socket sends the
+        // stream, and connecting to it makes the kernel drop datagrams from anywhere else.
+        if( s_rpc_header.m_request_id != p_stream_call->m_request_id
+            || ( !p_stream_call->m_connected && s_source_sockaddr_in.sin_addr.s_addr != p_stream_call->m_server_sockaddr_in.sin_addr.s_addr ) )
+        {
+            continue;
+        }
+
+        if( !p_stream_call->m_connected )
+        {
+            p_stream_call->m_stream_sockaddr_in = s_source_sockaddr_in;
+
+            if( connect( p_stream_call->m_socket_descriptor, ( struct sockaddr* )&p_stream_call->m_stream_sockaddr_in, sizeof( p_stream_call->m_stream_sockaddr_in ) ) < 0 )
+            {
+                perror( "Could not connect to stream socket." );
+                p_stream_call->m_failed = true;
+                break;
+            }
+
+            p_stream_call->m_connected = true;
+        }
+
+        waited_ms = 0;
+        chunk_size = decode_reply_payload( p_stream_call->m_buffer, recv_size_bytes, p_stream_call->m_inflated, &p_payload );
+
+        // Chunks are never resent, so a gap in the sequence numbers means the stream is incomplete.
+        if( !( s_rpc_header.m_flags & RPC_FLAG_STREAM ) || s_rpc_header.m_seq != p_stream_call->m_next_seq || chunk_size < 0 )
+        {
+            fprintf( stderr, "next_stream_chunk(): stream chunk %u is missing or malformed.\n", p_stream_call->m_next_seq );
+            p_stream_call->m_failed = true;
+            break;
+        }
+
+        p_stream_call->m_next_seq++;
+        p_stream_call->m_ended = ( s_rpc_header.m_flags & RPC_FLAG_STREAM_END ) != 0;
+
+        if( chunk_size > 0 )
+        {
+            p_chunk->return_val = ( void* )p_payload;
+            p_chunk->return_size = chunk_size;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Releases a stream handle.
+ *
+ * @param p_stream_call The stream handle obtained from open_stream_call().
+ *
+ * @return Returns true if the whole stream was received.
+ */
+bool close_stream_call( rpc_stream_call* p_stream_call )
+{
+    bool completed; ///< Whether the whole stream was received.
+
+    if( p_stream_call == NULL )
+    {
+        return false;
+    }
+
+    completed = p_stream_call->m_ended && !p_stream_call->m_failed;
+
+    // Closing the socket stops the credits, which makes the server give up on an unfinished stream.
+    close( p_stream_call->m_socket_descriptor );
+    free( p_stream_call );
+
+    return completed;
+}
+
+/**
+ * @brief Invokes a streaming procedure on the server and consumes its result chunk by chunk.
+ *
+ * @param servernameorip   The domain name or IPv4 address pertaining to the server.
+ * @param serverportnumber The port number corresponding to the server process.
+ * @param procedure_name   The procedure name corresponding to the streaming procedure to be invoked on the server.
+ * @param reader           The callback each chunk is handed to as it arrives.
+ * @param p_context        An opaque pointer passed through to reader.
+ * @param nparams          The number of variable arguments accepted by the remote procedure.
+ * @param ...              A variable number of arguments of structure var_arg.
+ *
+ * @return Returns true if the whole stream was received.
+ */
+bool make_stream_call( const char* servernameorip, const int serverportnumber, const char* procedure_name, stream_reader_type reader, void* p_context, const int nparams, ... )
+{
+    rpc_stream_call* sp_stream_call; ///< The stream being consumed.
+    return_type s_chunk;             ///< The current chunk.
+    va_list var_arg_list;            ///< Stores a list of unconstrained arguments.
+
+    va_start( var_arg_list, nparams );
+    sp_stream_call = open_stream_call_v( servernameorip, serverportnumber, procedure_name, nparams, var_arg_list );
+    va_end( var_arg_list );
+
+    if( sp_stream_call == NULL )
+    {
+        return false;
+    }
+
+    while( next_stream_chunk( sp_stream_call, &s_chunk ) )
+    {
+        if( !reader( s_chunk.return_val, s_chunk.return_size, p_context ) )
+        {
+            break;
+        }
+    }
+
+    return close_stream_call( sp_stream_call );
+}
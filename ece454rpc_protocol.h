@@ -0,0 +1,69 @@
+/* Wire format shared by the client and server stubs. Not part of the public interface. */
+#include <stdint.h>
+
+/* Size of the buffers used to send and receive a single datagram */
+#define RPC_BUFFER_SIZE      4096
+
+/* Header flags */
+#define RPC_FLAG_STREAM        0x1 /* request: the caller consumes the result as a stream; reply: datagram is a stream chunk */
+#define RPC_FLAG_STREAM_END    0x2 /* reply: last chunk of a stream */
+#define RPC_FLAG_STREAM_CREDIT 0x4 /* client to server: chunks with a sequence number below m_seq may be sent */
+#define RPC_FLAG_COMPRESSED    0x8 /* the payload after the size field is compressed; the size field holds its uncompressed size */
+#define RPC_FLAG_ACCEPT_COMPRESSED 0x10 /* request: the client can decompress the reply */
+#define RPC_FLAG_TRACE_SAMPLED 0x20 /* request: the client sampled this request for tracing */
+
+/* A good threshold to pass to rpc_set_compression_threshold(): the smallest payload, in bytes, that is worth compressing */
+#define RPC_COMPRESSION_THRESHOLD 512
+
+/* Number of stream chunks the server may send ahead of the client, and how often the client grants more */
+#define RPC_STREAM_WINDOW       16
+#define RPC_STREAM_CREDIT_BATCH ( RPC_STREAM_WINDOW / 2 )
+
+/* Seconds either side of a stream waits for its peer before giving up */
+#define RPC_STREAM_TIMEOUT_SEC  30
+
+/* Seconds make_remote_call() waits for a reply before returning an empty result */
+#define RPC_CALL_TIMEOUT_SEC    10
+
+/* Milliseconds the client waits for a chunk before granting its credit again, in case the credit was lost */
+#define RPC_STREAM_RETRY_MS     200
+
+/** @struct
+
+    @brief Defines the header that starts every request, reply, stream chunk and stream credit datagram.
+
+    Requests:  [rpc_header][size_t procedure name length][procedure name][uint32_t nparams]{[size_t arg size][arg]}
+    Replies:   [rpc_header][size_t return size][return value]
+    Chunks:    [rpc_header][size_t chunk size][chunk]
+    Credits:   [rpc_header]
+
+    With RPC_FLAG_COMPRESSED set, the arguments of a request are replaced by
+    [size_t uncompressed size][compressed bytes], and the return value or chunk of a reply is
+    replaced by its compressed bytes. The procedure name is never compressed, so the server can
+    route a request from its header and name alone.
+*/
+struct rpc_header
+{
+    uint32_t m_flags;      ///< A combination of RPC_FLAG_* values
+    uint32_t m_seq;        ///< The stream chunk sequence number, or the credit limit of a stream credit
+    uint64_t m_request_id; ///< The ID the client stub assigned to the request, echoed in every reply and chunk answering it
+};
+
+/* Offset of the return value or chunk in a reply datagram, and the largest value a single reply can carry */
+#define RPC_REPLY_PAYLOAD_OFFSET ( sizeof( struct rpc_header ) + sizeof( size_t ) )
+#define RPC_REPLY_CAPACITY       ( RPC_BUFFER_SIZE - ( int )RPC_REPLY_PAYLOAD_OFFSET )
+
+/* mybind() -- binds sockfd to a free port in the range the server listens on. See mybind.c. */
+struct sockaddr_in;
+extern int mybind(int sockfd, struct sockaddr_in *addr);
+
+/* The smallest payload in bytes that is compressed, or negative if compression is disabled. See rpc_compress.c. */
+extern int rpc_compression_threshold;
+
+/* rpc_compress() -- compresses src_size bytes of p_src into p_dst in the LZ4 block format. Returns the compressed
+ * size, or 0 if it does not fit in dst_capacity bytes. Pass a capacity below src_size to compress only when it pays. */
+extern int rpc_compress(const void *p_src, int src_size, void *p_dst, int dst_capacity);
+
+/* rpc_decompress() -- decompresses p_src into exactly dst_size bytes at p_dst. Returns dst_size, or -1 if the
+ * input is malformed. */
+extern int rpc_decompress(const void *p_src, int src_size, void *p_dst, int dst_size);
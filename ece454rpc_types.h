@@ -22,6 +22,53 @@ typedef struct arg {
  * array entries in the second argument. */
 typedef return_type (*fp_type)(const int, arg_type *);
 
+/* Opaque handle for the result stream of a streaming procedure invocation */
+typedef struct rpc_stream rpc_stream;
+
+/* Type for the writer callback handed to a streaming procedure. Each call
+ * emits the next chunk_size bytes of the result to the client, blocking while
+ * the client is too far behind. Returns false if the client has gone away, in
+ * which case the procedure should stop producing output. */
+typedef bool (*stream_writer_type)(rpc_stream *p_stream, const void *p_chunk,
+	                           const int chunk_size);
+
+/* Type for the function pointer of a streaming procedure. Instead of returning
+ * its result in one return_type, the procedure emits it incrementally through
+ * the writer. The stream ends when the procedure returns. */
+typedef void (*stream_fp_type)(const int, arg_type *, stream_writer_type,
+	                       rpc_stream *);
+
+/* Type for the reader callback with which client code consumes a stream
+ * chunk by chunk. p_chunk is only valid for the duration of the call. Return
+ * false to stop consuming the stream early. */
+typedef bool (*stream_reader_type)(const void *p_chunk, const int chunk_size,
+	                           void *p_context);
+
+/* Opaque handle for a stream being consumed by the client */
+typedef struct rpc_stream_call rpc_stream_call;
+
+/* Execution hint with which a procedure is registered. It tells
+ * launch_server() where to run the procedure:
+ *
+ * RPC_EXEC_INLINE    -- on the receive loop itself, with no thread handoff.
+ *                       Lowest latency, for procedures that return quickly.
+ * RPC_EXEC_POOLED    -- on a shared pool of worker threads, so a slow
+ *                       procedure does not hold up the receive loop.
+ * RPC_EXEC_DEDICATED -- on a worker thread of its own, so it cannot occupy
+ *                       the shared pool either.
+ * RPC_EXEC_AUTO      -- inline while its measured run time stays low, and
+ *                       on the shared pool once it does not.
+ *
+ * A procedure registered with anything but RPC_EXEC_INLINE may run
+ * concurrently with other procedures and must be thread-safe. Streams
+ * ignore the hint; each one runs on a thread of its own. */
+typedef enum {
+    RPC_EXEC_INLINE,
+    RPC_EXEC_POOLED,
+    RPC_EXEC_DEDICATED,
+    RPC_EXEC_AUTO
+} exec_hint_type;
+
 /******************************************************************/
 /* extern declarations -- you need to implement these 4 functions */
 /******************************************************************/
@@ -35,6 +82,64 @@ extern bool register_procedure(const char *procedure_name,
 	                       const int nparams,
 			       fp_type fnpointer);
 
+/* register_procedure_with_hint() -- same as register_procedure(), which
+ * registers with RPC_EXEC_INLINE, but with an explicit execution hint. */
+extern bool register_procedure_with_hint(const char *procedure_name,
+	                                 const int nparams,
+			                 fp_type fnpointer,
+			                 exec_hint_type exec_hint);
+
+/* register_stream_procedure() -- registers a streaming procedure with this
+ * server_stub. Clients invoke it with make_stream_call() or open_stream_call().
+ * Since a stream lasts as long as the client keeps consuming it, each stream
+ * runs on a thread of its own, so concurrent streams of the same procedure
+ * do not wait for each other. The procedure must be thread-safe. */
+extern bool register_stream_procedure(const char *procedure_name,
+	                              const int nparams,
+			              stream_fp_type fnpointer);
+
+/* Name of the streaming procedure launch_server() registers to dump its
+ * request trace. It takes an optional int argument; if non-zero, only
+ * requests sampled by the client are dumped. */
+#define RPC_TRACE_DUMP_PROCEDURE "__rpc_trace_dump"
+
+/* rpc_dump_trace() -- writes the most recent requests serviced by each
+ * thread of launch_server() to file descriptor fd, in the Chrome trace event
+ * JSON format: request ID, procedure, client address, and the times at which
+ * each request was received, dispatched and answered. For requests sampled by
+ * the client, the time at which the procedure returned is recorded as well.
+ * If sampled_only, only requests sampled by the client are written.
+ *
+ * The same dump is available to clients through RPC_TRACE_DUMP_PROCEDURE,
+ * and launch_server() writes it to rpc_trace.<pid>.json on the signal set
+ * with rpc_set_trace_dump_signal(). */
+extern bool rpc_dump_trace(int fd, bool sampled_only);
+
+/* rpc_set_server_port() -- makes launch_server() listen on the given port
+ * instead of searching for a free one. launch_server() exits if the port is
+ * taken. Passing 0, the default, restores the search. */
+extern void rpc_set_server_port(unsigned short port);
+
+/* rpc_set_server_port_file() -- makes launch_server() record the port it
+ * listens on in the file at path, and try that port first the next time it
+ * starts, so a restarted server comes back on the same port without a
+ * search. Each server needs its own file. Passing NULL disables it. */
+extern void rpc_set_server_port_file(const char *path);
+
+/* rpc_set_server_interface() -- names the network interface whose IPv4
+ * address launch_server() prints. Defaults to "eth0". If there is no such
+ * interface, the first non-loopback IPv4 address is printed instead. The
+ * server listens on all interfaces either way. */
+extern void rpc_set_server_interface(const char *name);
+
+/* rpc_set_trace_dump_signal() -- makes launch_server() write its request
+ * trace to rpc_trace.<pid>.json in the working directory whenever signal
+ * signo arrives, e.g. SIGUSR1. The signal is received through a signalfd,
+ * so no handler is installed; it is blocked in the calling thread, and
+ * must also be blocked in any thread created before the call. Defaults to
+ * 0, which leaves all signals alone. */
+extern void rpc_set_trace_dump_signal(int signo);
+
 /* launch_server() -- used by the app programmer's server code to indicate that
  * it wants start receiving rpc invocations for functions that it registered
  * with the server stub.
@@ -50,14 +155,87 @@ extern bool register_procedure(const char *procedure_name,
  */
 void launch_server();
 
+/* rpc_reply_buffer() -- may be invoked by a registered procedure while it is
+ * being serviced by launch_server(). Returns the calling thread's pooled reply
+ * buffer and stores its capacity in bytes in *p_capacity. A procedure can write
+ * its result directly into this buffer and return it as return_val, which lets
+ * launch_server() send the reply without any allocation or copy. The buffer is
+ * reused for the next request serviced on the same thread. */
+extern void *rpc_reply_buffer(int *p_capacity);
+
 /* The following needs to be implemented in the client stub. This is a
  * procedure with a variable number of arguments that the app programmer's
  * client code uses to invoke. The arguments should be self-explanatory.
  *
  * For each of the nparams parameters, we have two arguments: size of the
- * argument, and a (void *) to the argument. */
+ * argument, and a (void *) to the argument.
+ *
+ * make_remote_call() may be invoked from any number of threads at once. All
+ * of them share a few process wide UDP sockets, and replies are handed to the
+ * waiting thread by request ID, so no call opens a socket of its own. A forked
+ * child opens sockets of its own on its first call. If no reply arrives
+ * within RPC_CALL_TIMEOUT_SEC seconds, the call returns an empty result. */
 extern return_type make_remote_call(const char *servernameorip,
 	                            const int serverportnumber,
 	                            const char *procedure_name,
 	                            const int nparams,
 				    ...);
+
+/* rpc_set_compression_threshold() -- requests sent by the client stub and
+ * replies sent by the server stub whose payload is at least threshold bytes
+ * are compressed, unless compression does not shrink them. A negative
+ * threshold disables compression, which is the default; 512 bytes is a good
+ * threshold to start from. Decompression is always supported. */
+extern void rpc_set_compression_threshold(int threshold);
+
+/* rpc_set_trace_sample_rate() -- every request sent by the client stub
+ * carries a request ID. Every sample_every'th request is also marked as
+ * sampled, so it can be picked out of the server's trace. 0, the default,
+ * samples none. */
+extern void rpc_set_trace_sample_rate(unsigned int sample_every);
+
+/* make_remote_call_borrowed() -- identical to make_remote_call(), except that
+ * return_val is not allocated for the caller. Instead it borrows from one of
+ * the calling thread's pooled receive buffers, and must be handed back with
+ * release_return_value() on the same thread once the caller is done with it. */
+extern return_type make_remote_call_borrowed(const char *servernameorip,
+	                                     const int serverportnumber,
+	                                     const char *procedure_name,
+	                                     const int nparams,
+				             ...);
+
+/* release_return_value() -- returns the buffer behind a return value obtained
+ * from make_remote_call_borrowed() to the calling thread's pool, and resets
+ * *p_return_type to an empty return value. */
+extern void release_return_value(return_type *p_return_type);
+
+/* open_stream_call() -- invokes a streaming procedure and returns a handle
+ * from which its result is read with next_stream_chunk(), or NULL on failure.
+ * The server only runs ahead of the client by a bounded number of chunks, so
+ * neither side holds the whole result in memory. */
+extern rpc_stream_call *open_stream_call(const char *servernameorip,
+	                                 const int serverportnumber,
+	                                 const char *procedure_name,
+	                                 const int nparams,
+				         ...);
+
+/* next_stream_chunk() -- stores the next chunk of the stream in *p_chunk.
+ * return_val borrows from the stream and is only valid until the next call.
+ * Returns false once the stream has ended or failed. */
+extern bool next_stream_chunk(rpc_stream_call *p_stream_call,
+	                      return_type *p_chunk);
+
+/* close_stream_call() -- releases a handle obtained from open_stream_call().
+ * Returns true if the whole stream was received. */
+extern bool close_stream_call(rpc_stream_call *p_stream_call);
+
+/* make_stream_call() -- invokes a streaming procedure and hands each chunk of
+ * its result to reader as it arrives. Returns true if the whole stream was
+ * received. */
+extern bool make_stream_call(const char *servernameorip,
+	                     const int serverportnumber,
+	                     const char *procedure_name,
+	                     stream_reader_type reader,
+	                     void *p_context,
+	                     const int nparams,
+			     ...);
@@ -4,11 +4,26 @@
 
 // OLD PORT: 5673 Replace 56211 below with this in FINAL
 
+bool sum_chunk( const void* p_chunk, const int chunk_size, void* p_context )
+{
+    const int* values = ( const int * )p_chunk;
+    int i;
+
+    for( i = 0; i < chunk_size / ( int )sizeof( int ); i++ )
+    {
+        *( long * )p_context += values[i];
+    }
+
+    return true;
+}
+
 int main( int argc, char* argv[] )
 {
     int a = -10, b = 20;
     int v = 1, w = 2, x = 3, y = 4, z = 5;
     int waka1 = 18, waka2 = 19;
+    int count = 100000;
+    long sum = 0;
 
     if (argc != 3)
     {
@@ -38,7 +53,7 @@ int main( int argc, char* argv[] )
                                          sizeof( int ), ( void * )( &y ),
                                          sizeof( int ), ( void * )( &z ));
 
-     return_type ans3 = make_remote_call( serveraddr,
+     return_type ans3 = make_remote_call_borrowed( serveraddr,
                                             serverport,
                                         "addtwo", 2,
                                             sizeof( int ), ( void * )( &waka1 ),
@@ -51,5 +66,13 @@ int main( int argc, char* argv[] )
     int wakaderp = *( int *)( ans3.return_val );
     printf( "client, got result: %d %d %d\n", i, derp, wakaderp );
 
+    release_return_value( &ans3 );
+
+    if( make_stream_call( serveraddr, serverport, "sequence", sum_chunk, &sum, 1,
+                          sizeof( int ), ( void * )( &count ) ) )
+    {
+        printf( "client, got stream sum: %ld\n", sum );
+    }
+
     return 0;
 }
@@ -29,8 +29,10 @@ return_type add( const int nparams, arg_type* a )
 
     printf("i = %d, j = %d\n", i, j);
 
-    ret_int = i + j;
-    r.return_val = ( void * )( &ret_int );
+    /* Write the result straight into the reply buffer, so it is sent without a copy. */
+    int* p_sum = ( int * )rpc_reply_buffer( NULL );
+    *p_sum = i + j;
+    r.return_val = ( void * )( p_sum );
     r.return_size = sizeof( int );
 
     return r;
@@ -103,11 +105,42 @@ return_type multiplyFive(const int nparams, arg_type* a)
     return r;
 }
 
+void sequence(const int nparams, arg_type* a, stream_writer_type writer, rpc_stream* stream)
+{
+    int chunk[256];
+    int n, i, k;
+
+    printf("Entered the sequence function.\n");
+
+    if (nparams != 1 || a->arg_size != sizeof(int))
+    {
+        /* Error! An empty stream. */
+        return;
+    }
+
+    n = *(int *)(a->arg_val);
+
+    /* Emit 0 .. n-1 a chunk at a time, so the whole sequence is never held in memory. */
+    for (i = 0; i < n; i += k)
+    {
+        for (k = 0; k < 256 && i + k < n; k++)
+        {
+            chunk[k] = i + k;
+        }
+
+        if (!writer(stream, chunk, k * sizeof(int)))
+        {
+            return;
+        }
+    }
+}
+
 int main() 
 {
     bool procedure_registered = register_procedure( "addtwo", 2, add );
     bool procedure_registered_again_again = register_procedure("multfive", 5, multiplyFive);
     bool procedure_registered_again = register_procedure( "multtwo", 2, multiply);
+    bool stream_procedure_registered = register_stream_procedure( "sequence", 1, sequence );
 
     if (!procedure_registered)
     {
@@ -0,0 +1,302 @@
+#include <stdint.h>
+#include <string.h>
+#include "ece454rpc_types.h"
+#include "ece454rpc_protocol.h"
+
+/* LZ4 block format parameters */
+#define HASH_LOG      12
+#define MIN_HASH_LOG  8
+#define MIN_MATCH     4
+#define LAST_LITERALS 5
+#define MFLIMIT       12
+#define MAX_OFFSET    65535
+#define MAX_INPUT     65535 /* positions in the hash table are 16 bits */
+#define SKIP_TRIGGER  6     /* after every 2^SKIP_TRIGGER missed positions, the matcher steps one byte further */
+
+/* Payloads of at least this many bytes are compressed. Negative disables compression, which is the default. */
+int rpc_compression_threshold = -1;
+
+/**
+ * @brief Sets the size above which requests and replies are compressed.
+ *
+ * @param threshold The smallest payload in bytes that is compressed, or a negative value to disable compression.
+ */
+void rpc_set_compression_threshold( int threshold )
+{
+    rpc_compression_threshold = threshold;
+}
+
+/**
+ * @brief Reads four bytes from a possibly unaligned address.
+ */
+static uint32_t read32( const uint8_t* p )
+{
+    uint32_t value; ///< The value read.
+
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+/**
+ * @brief Hashes the four bytes at the start of a potential match into a table of 2^hash_log entries.
+ */
+static uint32_t hash32( uint32_t value, int hash_log )
+{
+    return ( value * 2654435761U ) >> ( 32 - hash_log );
+}
+
+/**
+ * @brief Writes the 255-continued tail of a literal or match length that did not fit in its token nibble.
+ */
+static uint8_t* write_length( uint8_t* p_dst, size_t length )
+{
+    while( length >= 255 )
+    {
+        *p_dst++ = 255;
+        length -= 255;
+    }
+
+    *p_dst++ = ( uint8_t )length;
+    return p_dst;
+}
+
+/**
+ * @brief Compresses a buffer into the LZ4 block format with a single pass greedy matcher. Like LZ4, the matcher
+ *        steps further ahead the longer it goes without a match, so incompressible input is given up on quickly.
+ *
+ * @param p_src        The payload to be compressed.
+ * @param src_size     The size of p_src in bytes.
+ * @param p_dst        Receives the compressed payload.
+ * @param dst_capacity The size of p_dst in bytes.
+ *
+ * @return The size of the compressed payload, or 0 if it does not fit in dst_capacity bytes or p_src is larger
+ *         than MAX_INPUT bytes.
+ */
+int rpc_compress( const void* p_src, int src_size, void* p_dst, int dst_capacity )
+{
+    const uint8_t* src = ( const uint8_t* )p_src;   ///< The start of the payload.
+    const uint8_t* ip = src;                        ///< The current input position.
+    const uint8_t* anchor = src;                    ///< The start of the pending literals.
+    const uint8_t* iend = src + src_size;           ///< One past the end of the payload.
+    const uint8_t* mflimit;                         ///< A match may not start at or after this position.
+    const uint8_t* matchlimit;                      ///< A match may not extend to or past this position.
+    const uint8_t* match;                           ///< The earlier occurrence of the bytes at ip.
+    uint8_t* op = ( uint8_t* )p_dst;                ///< The current output position.
+    uint8_t* oend = op + dst_capacity;              ///< One past the end of the output.
+    uint8_t* token;                                 ///< The token of the sequence being written.
+    uint16_t table[1 << HASH_LOG];                  ///< The last input position seen for each hash.
+    int hash_log = MIN_HASH_LOG;                    ///< The number of table entries in use is 2^hash_log.
+    unsigned int misses = 0;                        ///< The number of positions tried since the last match.
+    uint32_t h;                                     ///< The hash of the bytes at ip.
+    size_t literal_length;                          ///< The number of pending literals.
+    size_t match_length;                            ///< The length of the current match.
+
+    if( src_size < 0 || src_size > MAX_INPUT || dst_capacity <= 0 )
+    {
+        return 0;
+    }
+
+    // Only clear as much of the table as the payload needs. A stale or zero entry is harmless, since every
+    // candidate match is compared against the input before it is used.
+    while( hash_log < HASH_LOG && ( 1 << hash_log ) < src_size )
+    {
+        hash_log++;
+    }
+
+    memset( table, 0, sizeof( table[0] ) << hash_log );
+
+    // Payloads too short to hold a match are emitted as literals.
+    mflimit = src_size > MFLIMIT ? iend - MFLIMIT : src;
+    matchlimit = src_size > MFLIMIT ? iend - LAST_LITERALS : src;
+
+    while( ip < mflimit )
+    {
+        h = hash32( read32( ip ), hash_log );
+        match = src + table[h];
+        table[h] = ( uint16_t )( ip - src );
+
+        if( match >= ip || read32( match ) != read32( ip ) )
+        {
+            ip += 1 + ( misses++ >> SKIP_TRIGGER );
+            continue;
+        }
+
+        misses = 0;
+
+        // Extend the match backwards over pending literals, then forwards.
+        while( ip > anchor && match > src && ip[-1] == match[-1] )
+        {
+            ip--;
+            match--;
+        }
+
+        match_length = MIN_MATCH;
+
+        while( ip + match_length < matchlimit && ip[match_length] == match[match_length] )
+        {
+            match_length++;
+        }
+
+        literal_length = ip - anchor;
+
+        if( ( size_t )( oend - op ) < 1 + literal_length / 255 + 1 + literal_length + 2 + ( match_length - MIN_MATCH ) / 255 + 1 )
+        {
+            return 0;
+        }
+
+        // Emit the literals followed by the match.
+        token = op++;
+        *token = ( uint8_t )( ( literal_length < 15 ? literal_length : 15 ) << 4 );
+
+        if( literal_length >= 15 )
+        {
+            op = write_length( op, literal_length - 15 );
+        }
+
+        memcpy( op, anchor, literal_length );
+        op += literal_length;
+        *op++ = ( uint8_t )( ( ip - match ) & 0xff );
+        *op++ = ( uint8_t )( ( ip - match ) >> 8 );
+        *token |= ( uint8_t )( match_length - MIN_MATCH < 15 ? match_length - MIN_MATCH : 15 );
+
+        if( match_length - MIN_MATCH >= 15 )
+        {
+            op = write_length( op, match_length - MIN_MATCH - 15 );
+        }
+
+        ip += match_length;
+        anchor = ip;
+    }
+
+    // The last sequence holds only literals.
+    literal_length = iend - anchor;
+
+    if( ( size_t )( oend - op ) < 1 + literal_length / 255 + 1 + literal_length )
+    {
+        return 0;
+    }
+
+    token = op++;
+    *token = ( uint8_t )( ( literal_length < 15 ? literal_length : 15 ) << 4 );
+
+    if( literal_length >= 15 )
+    {
+        op = write_length( op, literal_length - 15 );
+    }
+
+    memcpy( op, anchor, literal_length );
+    op += literal_length;
+
+    return op - ( uint8_t* )p_dst;
+}
+
+/**
+ * @brief Decompresses an LZ4 block format payload, rejecting any input that would read or write out of bounds.
+ *
+ * @param p_src    The compressed payload.
+ * @param src_size The size of p_src in bytes.
+ * @param p_dst    Receives the decompressed payload.
+ * @param dst_size The expected size of the decompressed payload in bytes.
+ *
+ * @return dst_size on success, or -1 if the payload is malformed or does not decompress to dst_size bytes.
+ */
+int rpc_decompress( const void* p_src, int src_size, void* p_dst, int dst_size )
+{
+    const uint8_t* ip = ( const uint8_t* )p_src; ///< The current input position.
+    const uint8_t* iend = ip + src_size;         ///< One past the end of the input.
+    uint8_t* dst = ( uint8_t* )p_dst;            ///< The start of the output.
+    uint8_t* op = dst;                           ///< The current output position.
+    uint8_t* oend = dst + dst_size;              ///< One past the end of the output.
+    const uint8_t* match;                        ///< The start of the current match.
+    uint8_t token;                               ///< The token of the current sequence.
+    uint8_t byte;                                ///< The current byte of a continued length.
+    size_t literal_length;                       ///< The number of literals in the current sequence.
+    size_t match_length;                         ///< The length of the current match.
+    size_t offset;                               ///< The distance back to the current match.
+
+    if( src_size <= 0 || dst_size < 0 )
+    {
+        return -1;
+    }
+
+    while( ip < iend )
+    {
+        token = *ip++;
+        literal_length = token >> 4;
+
+        if( literal_length == 15 )
+        {
+            do
+            {
+                if( ip >= iend )
+                {
+                    return -1;
+                }
+
+                byte = *ip++;
+                literal_length += byte;
+            } while( byte == 255 );
+        }
+
+        if( literal_length > ( size_t )( iend - ip ) || literal_length > ( size_t )( oend - op ) )
+        {
+            return -1;
+        }
+
+        memcpy( op, ip, literal_length );
+        op += literal_length;
+        ip += literal_length;
+
+        // The last sequence has no match.
+        if( ip == iend )
+        {
+            break;
+        }
+
+        if( iend - ip < 2 )
+        {
+            return -1;
+        }
+
+        offset = ip[0] | ( ip[1] << 8 );
+        ip += 2;
+
+        if( offset == 0 || offset > ( size_t )( op - dst ) )
+        {
+            return -1;
+        }
+
+        match_length = token & 15;
+
+        if( match_length == 15 )
+        {
+            do
+            {
+                if( ip >= iend )
+                {
+                    return -1;
+                }
+
+                byte = *ip++;
+                match_length += byte;
+            } while( byte == 255 );
+        }
+
+        match_length += MIN_MATCH;
+
+        if( match_length > ( size_t )( oend - op ) )
+        {
+            return -1;
+        }
+
+        // Copy byte by byte, since a match may overlap the bytes it produces.
+        match = op - offset;
+
+        while( match_length-- > 0 )
+        {
+            *op++ = *match++;
+        }
+    }
+
+    return op == oend ? dst_size : -1;
+}
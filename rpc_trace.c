@@ -0,0 +1,499 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ece454rpc_types.h"
+#include "ece454rpc_protocol.h"
+#include "rpc_trace.h"
+
+#define TRACE_LINE_SIZE 512
+#define TRACE_CALIBRATION_NS 10000000 /* Time after trace_start() from which the tick rate is measured precisely enough to keep */
+
+/** @struct
+
+    @brief Defines a thread's trace ring. Only the owning thread writes to it, so recording a request takes no lock;
+           a reader detects records that were overwritten while it copied them through their m_seq.
+*/
+struct trace_ring
+{
+    uint64_t            m_head;                       ///< The number of records ever written to the ring
+    int                 m_index;                      ///< The position of the ring in s_trace_rings, used as the thread ID of its events
+    bool                m_in_use;                     ///< Whether a thread owns the ring; a released ring is claimed by the next new thread
+    struct trace_record m_records[TRACE_RING_SIZE];   ///< The most recent records
+};
+
+/* Every trace ring created so far. Entries are only ever added; rings released by exited threads are reused. */
+static struct trace_ring* s_trace_rings[MAX_TRACE_RINGS];
+static int s_trace_ring_count = 0;
+
+/* The calling thread's trace ring, and whether the thread could not get one. */
+static __thread struct trace_ring* sp_thread_trace_ring = NULL;
+static __thread bool s_thread_trace_ring_unavailable = false;
+
+/* The calling thread's last record, if it still waits for its send time. */
+static __thread struct trace_record* sp_thread_pending_record = NULL;
+
+/* The tick count and monotonic time in nanoseconds when tracing started. */
+static uint64_t s_start_ticks = 0;
+static uint64_t s_start_ns = 0;
+
+/* Nanoseconds per 1024 trace ticks, or 0 until TRACE_CALIBRATION_NS have passed since trace_start(). */
+static uint64_t s_ns_per_kilotick = 0;
+
+/**
+ * @brief Returns the current time of the monotonic clock in nanoseconds.
+ */
+static uint64_t trace_monotonic_ns()
+{
+    struct timespec s_timespec; ///< The current monotonic time.
+
+    clock_gettime( CLOCK_MONOTONIC, &s_timespec );
+    return ( uint64_t )s_timespec.tv_sec * 1000000000ULL + s_timespec.tv_nsec;
+}
+
+/**
+ * @brief Returns the calling thread's trace ring, creating it on first use.
+ *
+ * @return The trace ring, or NULL if MAX_TRACE_RINGS threads already have one.
+ */
+static struct trace_ring* thread_trace_ring()
+{
+    struct trace_ring* sp_trace_ring; ///< A ring that may have been released.
+    bool in_use = false;              ///< The expected m_in_use of a released ring.
+    int ring_count;                   ///< The number of trace rings created so far.
+    int index;                        ///< The position of the new ring in s_trace_rings.
+
+    if( sp_thread_trace_ring != NULL || s_thread_trace_ring_unavailable )
+    {
+        return sp_thread_trace_ring;
+    }
+
+    // Claim a ring released by an exited thread. Its old records stay in the dump, on the same thread ID.
+    ring_count = __atomic_load_n( &s_trace_ring_count, __ATOMIC_RELAXED );
+    ring_count = ring_count < MAX_TRACE_RINGS ? ring_count : MAX_TRACE_RINGS;
+
+    for( index = 0; index < ring_count; index++ )
+    {
+        sp_trace_ring = __atomic_load_n( &s_trace_rings[index], __ATOMIC_ACQUIRE );
+        in_use = false;
+
+        if( sp_trace_ring != NULL && __atomic_compare_exchange_n( &sp_trace_ring->m_in_use, &in_use, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+        {
+            sp_thread_trace_ring = sp_trace_ring;
+            return sp_thread_trace_ring;
+        }
+    }
+
+    index = __atomic_fetch_add( &s_trace_ring_count, 1, __ATOMIC_RELAXED );
+    sp_thread_trace_ring = index < MAX_TRACE_RINGS ? ( struct trace_ring* )calloc( 1, sizeof( struct trace_ring ) ) : NULL;
+
+    if( sp_thread_trace_ring == NULL )
+    {
+        s_thread_trace_ring_unavailable = true;
+        return NULL;
+    }
+
+    sp_thread_trace_ring->m_index = index;
+    sp_thread_trace_ring->m_in_use = true;
+    __atomic_store_n( &s_trace_rings[index], sp_thread_trace_ring, __ATOMIC_RELEASE );
+
+    return sp_thread_trace_ring;
+}
+
+/**
+ * @brief Creates the calling thread's trace ring, so its first request does not pay for the allocation.
+ */
+void trace_attach_thread()
+{
+    thread_trace_ring();
+}
+
+/**
+ * @brief Releases the calling thread's trace ring before the thread exits, so a later thread can reuse it.
+ */
+void trace_detach_thread()
+{
+    trace_idle();
+
+    if( sp_thread_trace_ring != NULL )
+    {
+        __atomic_store_n( &sp_thread_trace_ring->m_in_use, false, __ATOMIC_RELEASE );
+    }
+
+    sp_thread_trace_ring = NULL;
+    s_thread_trace_ring_unavailable = false;
+}
+
+/**
+ * @brief Claims the oldest record of the calling thread's trace ring, to be overwritten in place. Writing the
+ *        record directly into the ring saves copying it there.
+ *
+ * @return The record, marked as being written, or NULL if the thread has no trace ring.
+ */
+static struct trace_record* trace_begin_record()
+{
+    struct trace_ring* sp_trace_ring = thread_trace_ring(); ///< The calling thread's trace ring.
+    struct trace_record* sp_slot;                           ///< The record being overwritten.
+
+    if( sp_trace_ring == NULL )
+    {
+        return NULL;
+    }
+
+    sp_slot = &sp_trace_ring->m_records[sp_trace_ring->m_head & ( TRACE_RING_SIZE - 1 )];
+
+    // Mark the slot as being written, so a reader skips it until it is published.
+    __atomic_store_n( &sp_slot->m_seq, 0, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    return sp_slot;
+}
+
+/**
+ * @brief Publishes the record claimed by trace_begin_record() under its new sequence number.
+ *
+ * @param sp_trace_record The record returned by trace_begin_record().
+ */
+static void trace_commit_record( struct trace_record* sp_trace_record )
+{
+    uint64_t head = sp_thread_trace_ring->m_head; ///< The number of records written before this one.
+
+    __atomic_store_n( &sp_trace_record->m_seq, head + 1, __ATOMIC_RELEASE );
+    __atomic_store_n( &sp_thread_trace_ring->m_head, head + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief Reads the clock for the calling thread's next request. The reading is also the send time of the thread's
+ *        last request if that still waits for one, which then gets published.
+ *
+ * @return The current time in trace ticks.
+ */
+uint64_t trace_clock()
+{
+    uint64_t now_ticks = trace_now(); ///< The current time in trace ticks.
+
+    if( sp_thread_pending_record != NULL )
+    {
+        sp_thread_pending_record->m_send_ticks = now_ticks;
+        trace_commit_record( sp_thread_pending_record );
+        sp_thread_pending_record = NULL;
+    }
+
+    return now_ticks;
+}
+
+/**
+ * @brief Publishes the calling thread's last request, if it still waits for its send time, before the thread blocks.
+ */
+void trace_idle()
+{
+    if( sp_thread_pending_record != NULL )
+    {
+        trace_clock();
+    }
+}
+
+/**
+ * @brief Records a serviced request in the calling thread's trace ring. A request whose procedure was timed has its
+ *        reply sent by now, so the clock is read for its send time. Any other request saves that clock read: it
+ *        waits for the send time until the thread next calls trace_clock() or trace_idle().
+ *
+ * @param request_id        The request ID assigned by the client stub.
+ * @param p_procedure_name  The name of the registered procedure, or NULL if it was not registered.
+ * @param client_addr       The client IPv4 address, in network byte order.
+ * @param client_port       The client port, in network byte order.
+ * @param flags             A combination of TRACE_FLAG_* values.
+ * @param recv_ticks        When the request was received.
+ * @param dispatch_ticks    When the request started running.
+ * @param handler_ticks     When the procedure returned, or 0 if it was not timed.
+ */
+void trace_request( uint64_t request_id, const char* p_procedure_name, uint32_t client_addr, uint16_t client_port, uint16_t flags, uint64_t recv_ticks, uint64_t dispatch_ticks, uint64_t handler_ticks )
+{
+    struct trace_record* sp_trace_record; ///< The record of the request, written in place.
+
+    // A request served without trace_clock() marking its start ends the previous one.
+    if( sp_thread_pending_record != NULL )
+    {
+        sp_thread_pending_record->m_send_ticks = dispatch_ticks;
+        trace_commit_record( sp_thread_pending_record );
+        sp_thread_pending_record = NULL;
+    }
+
+    sp_trace_record = trace_begin_record();
+
+    if( sp_trace_record == NULL )
+    {
+        return;
+    }
+
+    sp_trace_record->m_request_id = request_id;
+    sp_trace_record->m_procedure_name = p_procedure_name;
+    sp_trace_record->m_client_addr = client_addr;
+    sp_trace_record->m_client_port = client_port;
+    sp_trace_record->m_flags = flags;
+    sp_trace_record->m_recv_ticks = recv_ticks;
+    sp_trace_record->m_dispatch_ticks = dispatch_ticks;
+    sp_trace_record->m_handler_ticks = handler_ticks;
+
+    if( handler_ticks != 0 )
+    {
+        sp_trace_record->m_send_ticks = trace_now();
+        trace_commit_record( sp_trace_record );
+    }
+    else
+    {
+        sp_thread_pending_record = sp_trace_record;
+    }
+}
+
+/**
+ * @brief Remembers the reference point that trace ticks are converted from, and creates the calling thread's
+ *        trace ring.
+ */
+void trace_start()
+{
+    s_start_ns = trace_monotonic_ns();
+    s_start_ticks = trace_now();
+    thread_trace_ring();
+}
+
+/**
+ * @brief Converts a duration in trace ticks to nanoseconds. The tick rate is measured against the monotonic clock
+ *        once, after which converting takes no clock read.
+ *
+ * @param ticks The duration in trace ticks.
+ *
+ * @return The duration in nanoseconds.
+ */
+uint64_t trace_ticks_to_ns( uint64_t ticks )
+{
+    uint64_t ns_per_kilotick = __atomic_load_n( &s_ns_per_kilotick, __ATOMIC_RELAXED ); ///< The measured tick rate.
+    uint64_t elapsed_ticks;                                                            ///< Trace ticks since trace_start().
+    uint64_t elapsed_ns;                                                               ///< Nanoseconds since trace_start().
+
+    if( ns_per_kilotick == 0 )
+    {
+        elapsed_ticks = trace_now() - s_start_ticks;
+        elapsed_ns = trace_monotonic_ns() - s_start_ns;
+
+        if( elapsed_ticks == 0 )
+        {
+            return ticks;
+        }
+
+        ns_per_kilotick = elapsed_ns * 1024 / elapsed_ticks;
+
+        if( elapsed_ns >= TRACE_CALIBRATION_NS )
+        {
+            __atomic_store_n( &s_ns_per_kilotick, ns_per_kilotick, __ATOMIC_RELAXED );
+        }
+    }
+
+    return ticks * ns_per_kilotick / 1024;
+}
+
+/**
+ * @brief Copies a string into a JSON string literal body, escaping quotes and backslashes and dropping control characters.
+ */
+static void json_escape( char* p_dst, size_t capacity, const char* p_src )
+{
+    size_t length = 0; ///< The number of characters written to p_dst.
+
+    for( ; *p_src != '\0' && length + 3 < capacity; p_src++ )
+    {
+        if( *p_src == '"' || *p_src == '\\' )
+        {
+            p_dst[length++] = '\\';
+            p_dst[length++] = *p_src;
+        }
+        else if( ( unsigned char )*p_src >= 0x20 )
+        {
+            p_dst[length++] = *p_src;
+        }
+    }
+
+    p_dst[length] = '\0';
+}
+
+/**
+ * @brief Appends text to the batch of a trace dump, first passing the batch to the sink if the text does not fit.
+ *
+ * @return Returns false if the sink failed.
+ */
+static bool trace_batch_append( trace_sink_type sink, void* p_context, char* p_batch, int* p_batch_length, const char* p_text, int size )
+{
+    if( *p_batch_length + size > RPC_REPLY_CAPACITY )
+    {
+        if( !sink( p_context, p_batch, *p_batch_length ) )
+        {
+            return false;
+        }
+
+        *p_batch_length = 0;
+    }
+
+    memcpy( p_batch + *p_batch_length, p_text, size );
+    *p_batch_length += size;
+
+    return true;
+}
+
+/**
+ * @brief Writes the records of every trace ring as Chrome trace event JSON. Each request becomes one complete event
+ *        on the thread that ran it, spanning from dispatch to the reply being sent. Requests whose procedure was
+ *        timed separately from the reply also show how that span divides between the two; for the others, the
+ *        reply counts as sent when the thread picked up its next request or went idle. The text is passed to sink
+ *        in batches of up to RPC_REPLY_CAPACITY bytes, each of which fills one stream chunk.
+ *
+ * @param sink          The callback the JSON text is written to.
+ * @param p_context     An opaque pointer passed through to sink.
+ * @param sampled_only  If true, only requests the client marked as sampled are written.
+ *
+ * @return Returns true if the whole dump was written.
+ */
+bool trace_dump( trace_sink_type sink, void* p_context, bool sampled_only )
+{
+    char batch[RPC_REPLY_CAPACITY];             ///< The text not yet passed to sink.
+    char line[TRACE_LINE_SIZE];                 ///< The JSON text of the current event.
+    char procedure_name[128];                   ///< The escaped procedure name of the current event.
+    char client_addr[INET_ADDRSTRLEN];          ///< The client address of the current event.
+    char phases[80];                            ///< The handler and send times of the current event, if it has them.
+    struct trace_ring* sp_trace_ring;           ///< The trace ring being dumped.
+    struct trace_record s_trace_record;         ///< A consistent copy of the current record.
+    struct in_addr s_in_addr;                   ///< The client address of the current event.
+    uint64_t head;                              ///< The number of records ever written to the ring.
+    uint64_t seq;                               ///< The sequence number of the current record.
+    uint64_t record_seq;                        ///< The sequence number the current record was published under.
+    uint64_t now_ticks = trace_now();           ///< The current time in trace ticks.
+    uint64_t now_ns = trace_monotonic_ns();     ///< The current monotonic time in nanoseconds.
+    double us_per_tick;                         ///< Converts trace ticks to microseconds.
+    bool first = true;                          ///< Whether no event has been written yet.
+    int ring_count;                             ///< The number of trace rings.
+    int idx;                                    ///< An index for for loops.
+    int length;                                 ///< The length of line.
+    int batch_length = 0;                       ///< The length of batch.
+
+    us_per_tick = now_ticks > s_start_ticks ? ( double )( now_ns - s_start_ns ) / ( now_ticks - s_start_ticks ) / 1000.0 : 0.001;
+    ring_count = __atomic_load_n( &s_trace_ring_count, __ATOMIC_RELAXED );
+    ring_count = ring_count < MAX_TRACE_RINGS ? ring_count : MAX_TRACE_RINGS;
+
+    if( !trace_batch_append( sink, p_context, batch, &batch_length, "{\"traceEvents\":[", 16 ) )
+    {
+        return false;
+    }
+
+    for( idx = 0; idx < ring_count; idx++ )
+    {
+        sp_trace_ring = __atomic_load_n( &s_trace_rings[idx], __ATOMIC_ACQUIRE );
+
+        if( sp_trace_ring == NULL )
+        {
+            continue;
+        }
+
+        head = __atomic_load_n( &sp_trace_ring->m_head, __ATOMIC_ACQUIRE );
+
+        for( seq = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0; seq < head; seq++ )
+        {
+            // Copy the record, and skip it if the owning thread overwrote it meanwhile.
+            record_seq = __atomic_load_n( &sp_trace_ring->m_records[seq & ( TRACE_RING_SIZE - 1 )].m_seq, __ATOMIC_ACQUIRE );
+            memcpy( &s_trace_record, &sp_trace_ring->m_records[seq & ( TRACE_RING_SIZE - 1 )], sizeof( s_trace_record ) );
+            __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+            if( record_seq != seq + 1 || __atomic_load_n( &sp_trace_ring->m_records[seq & ( TRACE_RING_SIZE - 1 )].m_seq, __ATOMIC_RELAXED ) != record_seq )
+            {
+                continue;
+            }
+
+            if( sampled_only && !( s_trace_record.m_flags & TRACE_FLAG_SAMPLED ) )
+            {
+                continue;
+            }
+
+            json_escape( procedure_name, sizeof( procedure_name ), s_trace_record.m_procedure_name != NULL ? s_trace_record.m_procedure_name : "<unregistered>" );
+            s_in_addr.s_addr = s_trace_record.m_client_addr;
+            inet_ntop( AF_INET, &s_in_addr, client_addr, sizeof( client_addr ) );
+            phases[0] = '\0';
+
+            if( s_trace_record.m_handler_ticks != 0 )
+            {
+                snprintf( phases, sizeof( phases ), ",\"handler_us\":%.3f,\"send_us\":%.3f",
+                          ( double )( s_trace_record.m_handler_ticks - s_trace_record.m_dispatch_ticks ) * us_per_tick,
+                          ( double )( s_trace_record.m_send_ticks - s_trace_record.m_handler_ticks ) * us_per_tick );
+            }
+
+            length = snprintf( line, sizeof( line ),
+                               "%s\n{\"name\":\"%s\",\"cat\":\"rpc\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                               "\"args\":{\"request_id\":\"%016llx\",\"client\":\"%s:%u\",\"queue_us\":%.3f%s,\"sampled\":%s,\"stream\":%s}}",
+                               first ? "" : ",",
+                               procedure_name,
+                               ( int )getpid(),
+                               sp_trace_ring->m_index,
+                               ( double )( int64_t )( s_trace_record.m_dispatch_ticks - s_start_ticks ) * us_per_tick,
+                               ( double )( s_trace_record.m_send_ticks - s_trace_record.m_dispatch_ticks ) * us_per_tick,
+                               ( unsigned long long )s_trace_record.m_request_id,
+                               client_addr,
+                               ntohs( s_trace_record.m_client_port ),
+                               ( double )( s_trace_record.m_dispatch_ticks - s_trace_record.m_recv_ticks ) * us_per_tick,
+                               phases,
+                               ( s_trace_record.m_flags & TRACE_FLAG_SAMPLED ) ? "true" : "false",
+                               ( s_trace_record.m_flags & TRACE_FLAG_STREAM ) ? "true" : "false" );
+
+            if( !trace_batch_append( sink, p_context, batch, &batch_length, line, length < ( int )sizeof( line ) ? length : ( int )sizeof( line ) - 1 ) )
+            {
+                return false;
+            }
+
+            first = false;
+        }
+    }
+
+    return trace_batch_append( sink, p_context, batch, &batch_length, "\n]}\n", 4 ) && sink( p_context, batch, batch_length );
+}
+
+/**
+ * @brief Writes trace text to a file descriptor.
+ */
+static bool write_to_fd( void* p_context, const char* p_text, int size )
+{
+    int fd = *( int* )p_context; ///< The file descriptor to write to.
+    ssize_t written;             ///< The number of bytes written by the last write().
+
+    while( size > 0 )
+    {
+        written = write( fd, p_text, size );
+
+        if( written < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if( written <= 0 )
+        {
+            return false;
+        }
+
+        p_text += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes the server's recently serviced requests to a file descriptor as Chrome trace event JSON.
+ *
+ * @param fd           The file descriptor to write to.
+ * @param sampled_only If true, only requests the client marked as sampled are written.
+ *
+ * @return Returns true if the whole trace was written.
+ */
+bool rpc_dump_trace( int fd, bool sampled_only )
+{
+    return trace_dump( write_to_fd, &fd, sampled_only );
+}
@@ -0,0 +1,83 @@
+/* Request tracing for the server stub. Not part of the public interface. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+/* Number of requests remembered by each thread's trace ring. Must be a power of two. */
+#define TRACE_RING_SIZE    1024
+
+/* Maximum number of threads with a trace ring */
+#define MAX_TRACE_RINGS    64
+
+/* Trace record flags */
+#define TRACE_FLAG_SAMPLED 0x1 /* the client marked the request as sampled */
+#define TRACE_FLAG_STREAM  0x2 /* the request was answered as a stream */
+
+/** @struct
+
+    @brief Defines the trace of one serviced request. Timestamps are in trace ticks, see trace_now().
+*/
+struct trace_record
+{
+    uint64_t    m_seq;              ///< Sequence number of the record within its ring plus one, or 0 while it is being written
+    uint64_t    m_request_id;       ///< The request ID assigned by the client stub
+    const char* m_procedure_name;   ///< The name of the registered procedure, or NULL if it was not registered
+    uint32_t    m_client_addr;      ///< The client IPv4 address, in network byte order
+    uint16_t    m_client_port;      ///< The client port, in network byte order
+    uint16_t    m_flags;            ///< A combination of TRACE_FLAG_* values
+    uint64_t    m_recv_ticks;       ///< When the request was received
+    uint64_t    m_dispatch_ticks;   ///< When the request started running
+    uint64_t    m_handler_ticks;    ///< When the procedure returned, or 0 if it was not timed separately from the reply
+    uint64_t    m_send_ticks;       ///< When the reply was sent, or if the procedure was not timed, when the thread moved on
+};
+
+/* trace_now() -- returns the current time in trace ticks. This is the time stamp counter where there is one,
+ * which is cheaper to read than clock_gettime(), and monotonic nanoseconds elsewhere. */
+static inline uint64_t trace_now()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    struct timespec s_timespec;
+
+    clock_gettime( CLOCK_MONOTONIC, &s_timespec );
+    return ( uint64_t )s_timespec.tv_sec * 1000000000ULL + s_timespec.tv_nsec;
+#endif
+}
+
+/* Type for the callback a trace dump is written to. Returns false to stop the dump. */
+typedef bool (*trace_sink_type)(void *p_context, const char *p_text, int size);
+
+/* trace_start() -- remembers the tick count and monotonic time that trace ticks are converted from. */
+extern void trace_start();
+
+/* trace_ticks_to_ns() -- converts a duration in trace ticks to nanoseconds. */
+extern uint64_t trace_ticks_to_ns(uint64_t ticks);
+
+/* trace_attach_thread() -- creates the calling thread's trace ring ahead of its first request. */
+extern void trace_attach_thread();
+
+/* trace_detach_thread() -- releases the calling thread's trace ring for reuse by a later thread. */
+extern void trace_detach_thread();
+
+/* trace_clock() -- returns the current time in trace ticks, for the receive or dispatch time of the calling thread's
+ * next request. The same reading ends the thread's last request, if that was recorded without a send time. */
+extern uint64_t trace_clock();
+
+/* trace_idle() -- ends the calling thread's last request, if that was recorded without a send time. Call it before
+ * the thread blocks, so the request is not held back from the dump. */
+extern void trace_idle();
+
+/* trace_request() -- records a serviced request in the calling thread's trace ring, once its reply is sent. A
+ * request with a handler_ticks of 0 is recorded without a send time, which saves a clock read; it is published by
+ * the thread's next trace_clock() or trace_idle(). */
+extern void trace_request(uint64_t request_id, const char *p_procedure_name, uint32_t client_addr,
+                          uint16_t client_port, uint16_t flags, uint64_t recv_ticks,
+                          uint64_t dispatch_ticks, uint64_t handler_ticks);
+
+/* trace_dump() -- writes the records of every trace ring to sink in the Chrome trace event JSON format. */
+extern bool trace_dump(trace_sink_type sink, void *p_context, bool sampled_only);
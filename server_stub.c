@@ -1,16 +1,39 @@
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <ifaddrs.h>
+#include <limits.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include "ece454rpc_types.h"
+#include "ece454rpc_protocol.h"
+#include "rpc_trace.h"
 
-#define  BUFFER_SIZE 4096
+#define  BUFFER_SIZE    RPC_BUFFER_SIZE
+#define  REPLY_CAPACITY RPC_REPLY_CAPACITY
+#define  MAX_PARAMS     ( BUFFER_SIZE / sizeof( size_t ) )
+#define  ARG_ALIGNMENT  sizeof( size_t )
+
+#define  WORKER_POOL_SIZE        4      ///< Number of threads serving RPC_EXEC_POOLED and offloaded RPC_EXEC_AUTO procedures
+#define  MAX_PENDING_WORK_ITEMS  1024   ///< Beyond this many handed-off requests, the receive loop rejects further ones with an empty reply
+#define  MAX_STREAM_THREADS      64     ///< Beyond this many streams in progress, new streams are rejected with an empty reply
+#define  AUTO_OFFLOAD_NS         50000  ///< An RPC_EXEC_AUTO procedure averaging longer than this is moved to the pool
+#define  TRACE_DUMP_CHECK_INTERVAL 1024 ///< While requests keep arriving, the receive loop checks for the trace dump signal this often
+#define  DEFAULT_INTERFACE_NAME  "eth0" ///< The interface whose address launch_server() prints by default
 
 /** @struct
  
@@ -20,23 +43,107 @@ struct procedure_element
 {
     char*                      m_procedure_name;             ///< The procedure name 
     int                        m_nparams;                    ///< The number of parameters accepted by the procedure 
-    fp_type                    m_fnpointer;                  ///< The function pointer to the procedure 
+    fp_type                    m_fnpointer;                  ///< The function pointer to the procedure, or NULL for a streaming procedure
+    stream_fp_type             m_stream_fnpointer;           ///< The function pointer to the streaming procedure, or NULL
+    exec_hint_type             m_exec_hint;                  ///< Where launch_server() runs the procedure
+    struct  work_queue*        m_sp_work_queue;              ///< The queue of the procedure's dedicated worker, for RPC_EXEC_DEDICATED
+    uint64_t                   m_latency_ns;                 ///< Moving average of the procedure's run time, for RPC_EXEC_AUTO
+    bool                       m_offloaded;                  ///< Whether an RPC_EXEC_AUTO procedure currently runs on the worker pool
     struct  procedure_element* m_sp_next_procedure_element;  ///< The pointer to the next registered procedure in the linked list 
 };
 
+/** @struct
+
+    @brief Defines a request handed off from the receive loop to a worker thread.
+*/
+struct work_item
+{
+    char               m_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) )); ///< A copy of the request datagram
+    int                m_size;                                                ///< The number of bytes in m_buffer
+    uint64_t           m_recv_ticks;                                          ///< When the request was received, in trace ticks
+    struct sockaddr_in m_client_sockaddr_in;                                  ///< The socket address of the client
+    socklen_t          m_addrlen;                                             ///< The length of m_client_sockaddr_in
+    struct work_item*  m_sp_next;                                             ///< The next item in the queue or free list
+};
+
+/** @struct
+
+    @brief Defines a queue of requests served by one or more worker threads.
+*/
+struct work_queue
+{
+    pthread_mutex_t   m_mutex;    ///< Protects the queue
+    pthread_cond_t    m_cond;     ///< Signalled when an item is queued
+    struct work_item* m_sp_head;  ///< The oldest queued item
+    struct work_item* m_sp_tail;  ///< The newest queued item
+};
+
+/** @struct
+
+    @brief Defines the server side state of a stream being produced by a streaming procedure.
+*/
+struct rpc_stream
+{
+    int      m_socket_descriptor; ///< The socket dedicated to this stream, connected to the client
+    uint32_t m_seq;               ///< The sequence number of the next chunk
+    uint32_t m_credit;            ///< Chunks with a sequence number below m_credit may be sent
+    bool     m_compress;          ///< Whether the client accepts compressed chunks
+    bool     m_failed;            ///< Whether the client has gone away
+    uint64_t m_request_id;        ///< The ID of the request the stream answers
+};
+
 /* A pointer to the head of the linked list storing registered procedures */
 struct procedure_element* sp_procedure_list_head_element = NULL;
 
+/* The queue of the shared worker pool, and whether its threads are running. */
+static struct work_queue s_worker_pool_queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL };
+static bool s_worker_pool_started = false;
+
+/* Work items are recycled through a free list, so handing off a request only allocates until the peak backlog is reached. */
+static pthread_mutex_t s_work_item_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct work_item* sp_free_work_items = NULL;
+static int s_pending_work_items = 0;
+
+/* The number of streams being served by a thread of their own. */
+static int s_stream_thread_count = 0;
+
+/* The server socket, shared by the receive loop and the worker threads. */
+static int s_server_socket_descriptor = -1;
+
+/* Startup configuration set by the rpc_set_server_*() functions. NULL strings select the defaults. */
+static unsigned short s_server_port = 0;
+static char* sp_server_port_file = NULL;
+static char* sp_server_interface_name = NULL;
+static int s_trace_dump_signal = 0;
+
+/* The receiving thread's pooled request buffer. */
+static __thread char s_recv_buffer[BUFFER_SIZE];
+
+/* The servicing thread's pooled argument list, and aligned storage for the argument values. Since every
+ * argument in a request is preceded by a size_t header, padding each value to ARG_ALIGNMENT never needs
+ * more than BUFFER_SIZE bytes. */
+static __thread arg_type s_arg_pool[MAX_PARAMS];
+static __thread char s_arg_storage[BUFFER_SIZE] __attribute__(( aligned( 16 ) ));
+
+/* The servicing thread's buffer for decompressed requests, and the sending thread's buffer for compressed replies. */
+static __thread char s_inflate_buffer[BUFFER_SIZE] __attribute__(( aligned( 16 ) ));
+static __thread char s_deflate_buffer[BUFFER_SIZE];
+
+/* The servicing thread's pooled reply buffer. See rpc_reply_buffer(). */
+static __thread char s_reply_buffer[REPLY_CAPACITY] __attribute__(( aligned( 16 ) ));
+
 /**
- * @brief This function registers a function in server stub.
+ * @brief This function registers a regular or streaming procedure in server stub.
  *
- * @param procedure_name The name of the procedure to be registered.
- * @param nparams        The number of arguments accepted by the procedure.
- * @param fnpointer      The function pointer to the procedure.
+ * @param procedure_name   The name of the procedure to be registered.
+ * @param nparams          The number of arguments accepted by the procedure.
+ * @param fnpointer        The function pointer to a regular procedure, or NULL.
+ * @param stream_fnpointer The function pointer to a streaming procedure, or NULL.
+ * @param exec_hint        Where launch_server() runs the procedure.
  *
  * @return Returns true if the procedure was registered successfully. Returns false otherwise.
  */
-bool register_procedure( const char* procedure_name, const int nparams, fp_type fnpointer )
+static bool register_procedure_element( const char* procedure_name, const int nparams, fp_type fnpointer, stream_fp_type stream_fnpointer, exec_hint_type exec_hint )
 {
     struct procedure_element* sp_procedure_element;                                               ///< Declare a pointer for a procedure element instance to be created.
     struct procedure_element* sp_procedure_list_current_element = sp_procedure_list_head_element; ///< Declare a pointer to the current element in the procedure element linked list.
@@ -56,6 +163,11 @@ bool register_procedure( const char* procedure_name, const int nparams, fp_type
     // Register the number of parameters accepted by the procedure, its function pointer, and the next procedure element.
     sp_procedure_element->m_nparams = nparams;
     sp_procedure_element->m_fnpointer = fnpointer;
+    sp_procedure_element->m_stream_fnpointer = stream_fnpointer;
+    sp_procedure_element->m_exec_hint = exec_hint;
+    sp_procedure_element->m_sp_work_queue = NULL;
+    sp_procedure_element->m_latency_ns = 0;
+    sp_procedure_element->m_offloaded = false;
     sp_procedure_element->m_sp_next_procedure_element = NULL;
 
     if( sp_procedure_list_head_element == NULL )
@@ -80,233 +192,1336 @@ bool register_procedure( const char* procedure_name, const int nparams, fp_type
 }
 
 /**
- * @brief This function maps a procedure name to a procedure.
+ * @brief This function registers a function in server stub.
+ *
+ * @param procedure_name The name of the procedure to be registered.
+ * @param nparams        The number of arguments accepted by the procedure.
+ * @param fnpointer      The function pointer to the procedure.
+ *
+ * @return Returns true if the procedure was registered successfully. Returns false otherwise.
+ */
+bool register_procedure( const char* procedure_name, const int nparams, fp_type fnpointer )
+{
+    return register_procedure_element( procedure_name, nparams, fnpointer, NULL, RPC_EXEC_INLINE );
+}
+
+/**
+ * @brief This function registers a function in server stub with an execution hint.
+ *
+ * @param procedure_name The name of the procedure to be registered.
+ * @param nparams        The number of arguments accepted by the procedure.
+ * @param fnpointer      The function pointer to the procedure.
+ * @param exec_hint      Where launch_server() runs the procedure.
+ *
+ * @return Returns true if the procedure was registered successfully. Returns false otherwise.
+ */
+bool register_procedure_with_hint( const char* procedure_name, const int nparams, fp_type fnpointer, exec_hint_type exec_hint )
+{
+    return register_procedure_element( procedure_name, nparams, fnpointer, NULL, exec_hint );
+}
+
+/**
+ * @brief This function registers a streaming function in server stub.
+ *
+ * @param procedure_name The name of the procedure to be registered.
+ * @param nparams        The number of arguments accepted by the procedure.
+ * @param fnpointer      The function pointer to the streaming procedure.
+ *
+ * @return Returns true if the procedure was registered successfully. Returns false otherwise.
+ */
+bool register_stream_procedure( const char* procedure_name, const int nparams, stream_fp_type fnpointer )
+{
+    // Every stream gets a thread of its own, so the hint only matters if the procedure is called without streaming.
+    return register_procedure_element( procedure_name, nparams, NULL, fnpointer, RPC_EXEC_INLINE );
+}
+
+/**
+ * @brief This function finds the registered procedure with a given name.
  *
  * @param  procedure_name The name of the procedure.
  *
- * @return Returns the function pointer registered to procedure_name. If no function
- *         pointer corresponding to procedure_name has been registered, return NULL.
+ * @return Returns the procedure element registered to procedure_name, or NULL if none has been registered.
  */
-fp_type map_procedure_name_to_fnpointer( const char* procedure_name )
+static struct procedure_element* find_procedure_element( const char* procedure_name )
 {
-    fp_type fnpointer = NULL;                                                        ///< Declare the function pointer to be returned.
     struct procedure_element* sp_procedure_element = sp_procedure_list_head_element; ///< Declare a pointer to the current element in the procedure element linked list.
 
     // Iterate through procedure element linked list to find procedure element with matching procedure name.
-    while( sp_procedure_element != NULL )
+    while( sp_procedure_element != NULL && strcmp( sp_procedure_element->m_procedure_name, procedure_name ) != 0 )
     {
-        if( strcmp( sp_procedure_element->m_procedure_name, procedure_name ) == 0 )
-        {
-            // If the current procedure element has a matching procedure name, return it.
-            fnpointer = sp_procedure_element->m_fnpointer;
-            break;
-        }
-        else
-        {
-            // Go to the next element in the procedure element linked list.
-            sp_procedure_element = sp_procedure_element->m_sp_next_procedure_element;
-        }
+        sp_procedure_element = sp_procedure_element->m_sp_next_procedure_element;
     }
-    
+
+    return sp_procedure_element;
+}
+
+/**
+ * @brief This function maps a procedure name to a procedure.
+ *
+ * @param  procedure_name The name of the procedure.
+ *
+ * @return Returns the function pointer registered to procedure_name. If no function
+ *         pointer corresponding to procedure_name has been registered, return NULL.
+ */
+fp_type map_procedure_name_to_fnpointer( const char* procedure_name )
+{
+    struct procedure_element* sp_procedure_element = find_procedure_element( procedure_name ); ///< The procedure element registered to procedure_name.
+
     // Return the function pointer.
-    return fnpointer;
+    return sp_procedure_element != NULL ? sp_procedure_element->m_fnpointer : NULL;
 }
 
 /**
- * @brief This function returns the IPv4 address corresponding to the eth0 network interface.
+ * @brief This function finds the IPv4 address of a network interface. If no interface has the given name, the
+ *        first non-loopback IPv4 address is used instead, and failing that the loopback address.
+ *
+ * @param p_interface_name The name of the network interface.
+ * @param p_addr           Receives the number and dots representation of the IPv4 address.
+ * @param capacity         The size of p_addr in bytes, at least INET_ADDRSTRLEN.
  *
- * @return Returns the number and dots representation of the IPv4 address for eth0
- *         as a C string.
+ * @return Returns true if an IPv4 address was found.
  */
-char* return_ip_addr()
+bool return_ip_addr( const char* p_interface_name, char* p_addr, socklen_t capacity )
 {
     struct sockaddr_in* sp_sockaddr_in;    ///< Declare a pointer to a sockaddr_in instance.
     struct ifaddrs* sp_ifaddrs_head;       ///< Declare a pointer to the head of the network interfaces linked list.
     struct ifaddrs* sp_ifaddrs_current;    ///< Declare a pointer to the current element in the network interfaces linked list.
-    char *addr;                            ///< Stores the IPv4 address pertaining to network interface eth0.
+    struct in_addr s_in_addr;              ///< The best IPv4 address found so far.
+    int rank = 0;                          ///< How good s_in_addr is: 0 none, 1 loopback, 2 other interface, 3 named interface.
+    int current_rank;                      ///< How good the address of the current interface is.
 
     // Builds a list of network interfaces and stores them starting at &sp_ifaddrs_head.
-    getifaddrs( &sp_ifaddrs_head );
-    
-    // Traverses through every network interface.
-    for( sp_ifaddrs_current = sp_ifaddrs_head; sp_ifaddrs_current; sp_ifaddrs_current = sp_ifaddrs_current->ifa_next )
+    if( getifaddrs( &sp_ifaddrs_head ) < 0 )
+    {
+        perror( "Could not list network interfaces." );
+        return false;
+    }
+
+    // Traverses through every network interface until the named one is found. Some interfaces have no address.
+    for( sp_ifaddrs_current = sp_ifaddrs_head; sp_ifaddrs_current != NULL && rank < 3; sp_ifaddrs_current = sp_ifaddrs_current->ifa_next )
     {
-        // If the interface belongs to the internet family.
-        if( sp_ifaddrs_current->ifa_addr->sa_family == AF_INET )
+        if( sp_ifaddrs_current->ifa_addr == NULL || sp_ifaddrs_current->ifa_addr->sa_family != AF_INET )
         {
-            sp_sockaddr_in = ( struct sockaddr_in* )sp_ifaddrs_current->ifa_addr;
-            addr = inet_ntoa( sp_sockaddr_in->sin_addr );
+            continue;
+        }
 
-            // If the interface name is equal to eth0, then we found the interface we want, break.
-            if( strcmp( sp_ifaddrs_current->ifa_name, "eth0" ) == 0 )
-            {
-                break;
-            }
+        if( strcmp( sp_ifaddrs_current->ifa_name, p_interface_name ) == 0 )
+        {
+            current_rank = 3;
+        }
+        else
+        {
+            current_rank = ( sp_ifaddrs_current->ifa_flags & IFF_LOOPBACK ) ? 1 : 2;
+        }
+
+        if( current_rank > rank )
+        {
+            sp_sockaddr_in = ( struct sockaddr_in* )sp_ifaddrs_current->ifa_addr;
+            s_in_addr = sp_sockaddr_in->sin_addr;
+            rank = current_rank;
         }
     }
-    
+
     // Free the block of memory allocated to the network interfaces linked list.
     freeifaddrs(sp_ifaddrs_head);
 
-    // Return the IPv4 address corresponding to network interface eth0.
-    return addr;
+    return rank > 0 && inet_ntop( AF_INET, &s_in_addr, p_addr, capacity ) != NULL;
 }
 
 /**
- * @brief This function starts the server listening for requests for function calls
- *        to functions registered by the server stub.
+ * @brief This function sets the port launch_server() listens on.
+ *
+ * @param port The port, or 0 to search for a free port.
  */
-void launch_server()
+void rpc_set_server_port( unsigned short port )
 {
-    int socket_descriptor;                    ///< Stores a files descriptor pertaining to a server socket.
-    int recv_size_bytes;                      ///< Stores the number of bytes received from the client.
-    char* server_ip_addr;                     ///< The IPv4 address of the server.
-    struct sockaddr_in s_server_sockaddr_in;  ///< Stores the server socket and port.
-    struct sockaddr_in s_client_sockaddr_in;  ///< Stores the client socket and port.
-    void* p_recv_buffer;                      ///< The buffer containing the remote procedure call arguments from the client.
-    void* p_recv_buffer_offset;               ///< Pointer to the current value in p_recv_buffer.
-    void* p_send_buffer;                      ///< The buffer containing the return value for the client.
-    void* p_send_buffer_offset;               ///< Pointer to the current value in p_send_buffer.
-    socklen_t addrlen;                        ///< Stores the length of s_client_sockaddr_in.
-    unsigned int idx;                         ///< An index for for loops.
-    arg_type* sp_arg_type_list_head;          ///< Points to the remote procedure call argument linked list.
-    arg_type* sp_current_arg_type_element;    ///< Pointer to the current arg in the arg_type linked list.
-    arg_type** sp_arg_type_array;             ///< An array of argtype* pointers to each arg in the arg_type linked list.
-    fp_type p_fnpointer;                      ///< Call function pointer.
-    return_type s_return_type;                ///< Stores the return value pertaining to the remote procedure call.
+    s_server_port = port;
+}
 
-    // Establish server socket
-    socket_descriptor = socket( AF_INET, SOCK_DGRAM, 0 );
-    
-    // If socket not established successfully, exit program.
-    if( socket_descriptor < 0 )
+/**
+ * @brief This function sets the file in which launch_server() remembers its port across restarts.
+ *
+ * @param path The path of the port file, or NULL to disable it.
+ */
+void rpc_set_server_port_file( const char* path )
+{
+    free( sp_server_port_file );
+    sp_server_port_file = path != NULL ? strdup( path ) : NULL;
+}
+
+/**
+ * @brief This function sets the network interface whose address launch_server() prints.
+ *
+ * @param name The name of the interface, or NULL for DEFAULT_INTERFACE_NAME.
+ */
+void rpc_set_server_interface( const char* name )
+{
+    free( sp_server_interface_name );
+    sp_server_interface_name = name != NULL ? strdup( name ) : NULL;
+}
+
+/**
+ * @brief This function sets the signal on which launch_server() writes its trace to rpc_trace.<pid>.json, and
+ *        blocks it in the calling thread, so threads created afterwards inherit the mask.
+ *
+ * @param signo The signal, or 0 to leave signals alone.
+ */
+void rpc_set_trace_dump_signal( int signo )
+{
+    sigset_t s_signal_set; ///< The trace dump signal.
+
+    s_trace_dump_signal = signo;
+
+    if( signo != 0 )
     {
-        perror( "Could not create server socket." );
-        exit( 1 );
+        sigemptyset( &s_signal_set );
+        sigaddset( &s_signal_set, signo );
+        pthread_sigmask( SIG_BLOCK, &s_signal_set, NULL );
     }
+}
 
-    // Obtain the IP address of the current machine
-    server_ip_addr = return_ip_addr();
-    
-    // Configure the server socket address and port number. Server can accept responses on all network interfaces.
-    memset( ( char* )&s_server_sockaddr_in, 0, sizeof( s_server_sockaddr_in ) );
-    s_server_sockaddr_in.sin_family = AF_INET;
-    s_server_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
+/**
+ * @brief This function reads the port recorded in the port file.
+ *
+ * @return Returns the recorded port, or 0 if there is no port file or it holds no valid port.
+ */
+static unsigned short read_port_file()
+{
+    FILE* p_file;           ///< The port file.
+    unsigned int port = 0;  ///< The recorded port.
 
-    // Bind address and port number to UDP socket. If bind unsuccessful, exit program.
-    if (mybind(socket_descriptor, &s_server_sockaddr_in) < 0)
+    if( sp_server_port_file == NULL || ( p_file = fopen( sp_server_port_file, "r" ) ) == NULL )
     {
-        perror("Could not bind address and port number to server socket.");
-        exit( 1 );
+        return 0;
     }
-    
-    // Print server IPv4 address and port number to stdout.
-    printf( "%s %d\n", server_ip_addr, ntohs( s_server_sockaddr_in.sin_port ) );
 
-    // Gets the length of s_client_sockaddr_in
-    addrlen = sizeof( s_client_sockaddr_in );
+    if( fscanf( p_file, "%u", &port ) != 1 || port > 65535 )
+    {
+        port = 0;
+    }
 
-    // Allocates a block of memory for incoming client RPC arguments.
-    p_recv_buffer = malloc(BUFFER_SIZE);
+    fclose( p_file );
+    return ( unsigned short )port;
+}
 
-    // Loop forever.
-    while( true )
+/**
+ * @brief This function records a port in the port file. The file is replaced atomically, so a concurrent reader
+ *        never sees a partial port.
+ *
+ * @param port The port to be recorded.
+ */
+static void write_port_file( unsigned short port )
+{
+    char temporary_path[PATH_MAX];  ///< The file the port is written to before it replaces the port file.
+    FILE* p_file;                   ///< The temporary file.
+
+    if( sp_server_port_file == NULL )
     {
-        // Attempt to receive request from client.
-        recv_size_bytes = recvfrom(socket_descriptor, p_recv_buffer, BUFFER_SIZE, 0, (struct sockaddr*)&s_client_sockaddr_in, &addrlen);
-        
-        if (recv_size_bytes <= 0)
-        {
-            // If could not receive request from client, set RPC return value to NULL.
-            perror( "Could not receive UDP packet from client." );
-            s_return_type.return_size = 0;
-            s_return_type.return_val = NULL;
-        }
-        else if (recv_size_bytes > 0)
-        {
-            // Read RPC arguments from client. 
-            p_recv_buffer_offset = p_recv_buffer;
-            size_t procedure_name_len = *(uint32_t*)p_recv_buffer_offset;
-            p_recv_buffer_offset = ( void* )( ( char* )p_recv_buffer_offset + sizeof( size_t ) );
-            char* procedure_name = ( char* )p_recv_buffer_offset;
-            p_recv_buffer_offset = ( void* )(( char* )p_recv_buffer_offset + procedure_name_len );
-            uint32_t nparams = *(uint32_t*)p_recv_buffer_offset;
-            p_recv_buffer_offset = ( void* )( ( char* )p_recv_buffer_offset + sizeof( uint32_t ) );
+        return;
+    }
 
-            sp_arg_type_list_head = NULL;
-            sp_current_arg_type_element = sp_arg_type_list_head;
-            sp_arg_type_array = (arg_type**)malloc(sizeof(arg_type*) * nparams);
+    snprintf( temporary_path, sizeof( temporary_path ), "%s.%d.tmp", sp_server_port_file, ( int )getpid() );
 
-            for (idx = 0; idx < nparams; idx++)
-            {
-                arg_type* s_arg_type = (arg_type *)malloc(sizeof(arg_type));
-                s_arg_type->arg_size = *( size_t* )p_recv_buffer_offset;
-                p_recv_buffer_offset = ( void* )( ( char* )p_recv_buffer_offset + sizeof( size_t ) );
-                
-                s_arg_type->arg_val = malloc(s_arg_type->arg_size);
-                memcpy(s_arg_type->arg_val, p_recv_buffer_offset, s_arg_type->arg_size);
-                p_recv_buffer_offset = (void*)((char*)p_recv_buffer_offset + s_arg_type->arg_size);
-                s_arg_type->next = NULL;
-                sp_arg_type_array[idx] = s_arg_type;
-                
-                if( sp_arg_type_list_head == NULL )
-                {
-                    sp_arg_type_list_head = s_arg_type;
-                    sp_current_arg_type_element = sp_arg_type_list_head;
-                }
-                else
-                {
-                    sp_current_arg_type_element->next = s_arg_type;
-                    sp_current_arg_type_element = sp_current_arg_type_element->next;
-                }
-            }
+    if( ( p_file = fopen( temporary_path, "w" ) ) == NULL )
+    {
+        perror( "Could not write port file." );
+        return;
+    }
 
-            // Get registered function pointer from given procedure_name.
-            p_fnpointer = map_procedure_name_to_fnpointer( procedure_name );
-            
-            if (p_fnpointer != NULL)
-            {
-                // Call function pointed to by p_fnpointer if registered function exists and pass in RPC argument linked list.
-                s_return_type = (*p_fnpointer)(nparams, sp_arg_type_list_head);
-            }
-            else
-            {
-                // Set RPC return value to NULL if registered function does not exist.
-                s_return_type.return_size = 0;
-                s_return_type.return_val = NULL;
-            }
+    fprintf( p_file, "%u\n", port );
+
+    if( fclose( p_file ) != 0 || rename( temporary_path, sp_server_port_file ) < 0 )
+    {
+        perror( "Could not write port file." );
+        unlink( temporary_path );
+    }
+}
+
+/**
+ * @brief This function binds the server socket. An explicit port is bound directly. Otherwise the port recorded in
+ *        the port file is tried first, and only if it is taken does mybind() search for a free port. The port file
+ *        is only rewritten if the bound port differs from the recorded one.
+ *
+ * @param socket_descriptor      The server socket.
+ * @param sp_server_sockaddr_in  The address to bind, with a port of 0. Receives the bound port.
+ *
+ * @return Returns true if the socket was bound.
+ */
+static bool bind_server_socket( int socket_descriptor, struct sockaddr_in* sp_server_sockaddr_in )
+{
+    unsigned short recorded_port = read_port_file();                             ///< The port in the port file, or 0.
+    unsigned short port = s_server_port != 0 ? s_server_port : recorded_port;    ///< The port to try first.
+
+    if( port != 0 )
+    {
+        sp_server_sockaddr_in->sin_port = htons( port );
 
-            // Deallocate memory for each arg in the RPC argument linked list.
-            for(idx = 0; idx < nparams; idx++)
+        if( bind( socket_descriptor, ( struct sockaddr* )sp_server_sockaddr_in, sizeof( *sp_server_sockaddr_in ) ) == 0 )
+        {
+            if( port != recorded_port )
             {
-                free(sp_arg_type_array[idx]->arg_val);
-                free(sp_arg_type_array[idx]);
+                write_port_file( port );
             }
-            
-            // Deallocate memory for the sp_arg_type_array.
-            free(sp_arg_type_array);
-        }
 
-        // Place return value into p_send_buffer.
-        p_send_buffer = malloc(sizeof(size_t) + s_return_type.return_size);
-        p_send_buffer_offset = p_send_buffer;
-        memcpy( p_send_buffer_offset, &( s_return_type.return_size ), sizeof( size_t ) );
-        p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + sizeof( size_t ) );
-        
-        // Copy the RPC return value iff the return size is greater than 0.
-        if (s_return_type.return_size > 0)
-        {
-            memcpy( p_send_buffer_offset, s_return_type.return_val, s_return_type.return_size );
-            p_send_buffer_offset = ( void* )( ( char* )p_send_buffer_offset + s_return_type.return_size );
+            return true;
         }
-        
-        // Send the RPC return value to the client.
-        if (sendto(socket_descriptor, p_send_buffer, sizeof(size_t)+s_return_type.return_size, 0, (struct sockaddr*)&s_client_sockaddr_in, addrlen) < 0)
+
+        if( s_server_port != 0 )
         {
-            perror("Could not return result to client.");
+            return false;
         }
 
-        // Deallocate memory for the p_send_buffer.
-        free(p_send_buffer);
+        // The recorded port is taken, search for another one.
+        sp_server_sockaddr_in->sin_port = 0;
+    }
+
+    if( mybind( socket_descriptor, sp_server_sockaddr_in ) < 0 )
+    {
+        return false;
+    }
+
+    if( ntohs( sp_server_sockaddr_in->sin_port ) != recorded_port )
+    {
+        write_port_file( ntohs( sp_server_sockaddr_in->sin_port ) );
+    }
+
+    return true;
+}
+
+/**
+ * @brief This function returns the calling thread's pooled reply buffer.
+ *
+ * @param p_capacity If not NULL, receives the number of bytes that may be written to the buffer.
+ *
+ * @return Returns a pointer to the reply buffer of the calling thread.
+ */
+void* rpc_reply_buffer( int* p_capacity )
+{
+    if( p_capacity != NULL )
+    {
+        *p_capacity = REPLY_CAPACITY;
+    }
+
+    return s_reply_buffer;
+}
+
+/**
+ * @brief This function decodes the header and procedure name of a request, which is all the receive loop needs to
+ *        decide where the request runs. The arguments are left for decode_request_args().
+ *
+ * @param p_request              The buffer containing the remote procedure call arguments from the client.
+ * @param request_size           The number of bytes in p_request.
+ * @param sp_rpc_header          Receives the header of the request.
+ * @param psp_procedure_element  Receives the requested procedure, or NULL if it has not been registered.
+ * @param pp_args                Receives a pointer to the number of arguments that follows the procedure name.
+ *
+ * @return Returns true if the header and name were decoded. Returns false if the request is malformed.
+ */
+static bool decode_request_header( const char* p_request, int request_size, struct rpc_header* sp_rpc_header, struct procedure_element** psp_procedure_element, const char** pp_args )
+{
+    const char* p_request_offset = p_request;                 ///< Pointer to the current value in p_request.
+    const char* p_request_end = p_request + request_size;     ///< Pointer to one past the end of p_request.
+    size_t procedure_name_len;                                ///< The length of the procedure name including its terminating null character.
+
+    // Read the header first, so even a malformed request can be answered under its request ID.
+    memset( sp_rpc_header, 0, sizeof( struct rpc_header ) );
+
+    if( request_size >= ( int )sizeof( struct rpc_header ) )
+    {
+        memcpy( sp_rpc_header, p_request_offset, sizeof( struct rpc_header ) );
+    }
+
+    // Read the procedure name, which must be followed by at least the number of RPC arguments.
+    if( request_size < ( int )( sizeof( struct rpc_header ) + sizeof( size_t ) + sizeof( uint32_t ) ) )
+    {
+        return false;
+    }
+
+    p_request_offset += sizeof( struct rpc_header );
+    memcpy( &procedure_name_len, p_request_offset, sizeof( size_t ) );
+    p_request_offset += sizeof( size_t );
+
+    if( procedure_name_len == 0 || procedure_name_len > ( size_t )( p_request_end - p_request_offset ) - sizeof( uint32_t ) || p_request_offset[procedure_name_len - 1] != '\0' )
+    {
+        return false;
+    }
+
+    *psp_procedure_element = find_procedure_element( p_request_offset );
+    *pp_args = p_request_offset + procedure_name_len;
+
+    return true;
+}
+
+/**
+ * @brief This function decodes the arguments of a request into the pooled argument list, decompressing them if needed.
+ *
+ * @param p_args                 The number of arguments, as located by decode_request_header().
+ * @param p_request_end          One past the end of the request.
+ * @param sp_rpc_header          The header of the request.
+ * @param p_nparams              Receives the number of arguments in the pooled argument list.
+ *
+ * @return Returns true if the arguments were decoded. Returns false if the request is malformed.
+ */
+static bool decode_request_args( const char* p_args, const char* p_request_end, const struct rpc_header* sp_rpc_header, uint32_t* p_nparams )
+{
+    const char* p_request_offset = p_args;                    ///< Pointer to the current value of the request.
+    char* p_arg_storage_offset = s_arg_storage;               ///< Pointer to the next free byte in s_arg_storage.
+    unsigned int idx;                                         ///< An index for for loops.
+    size_t inflated_size;                                     ///< The size of compressed arguments once decompressed.
+    uint32_t nparams;                                         ///< The number of arguments sent by the client.
+    size_t arg_size;                                          ///< The size of the current argument in bytes.
+
+    memcpy( &nparams, p_request_offset, sizeof( uint32_t ) );
+    p_request_offset += sizeof( uint32_t );
+
+    if( nparams > MAX_PARAMS )
+    {
+        return false;
+    }
+
+    // Compressed arguments are decoded from their decompressed copy.
+    if( sp_rpc_header->m_flags & RPC_FLAG_COMPRESSED )
+    {
+        if( ( size_t )( p_request_end - p_request_offset ) < sizeof( size_t ) )
+        {
+            return false;
+        }
+
+        memcpy( &inflated_size, p_request_offset, sizeof( size_t ) );
+        p_request_offset += sizeof( size_t );
+
+        if( inflated_size > BUFFER_SIZE || rpc_decompress( p_request_offset, p_request_end - p_request_offset, s_inflate_buffer, inflated_size ) < 0 )
+        {
+            return false;
+        }
+
+        p_request_offset = s_inflate_buffer;
+        p_request_end = s_inflate_buffer + inflated_size;
+    }
+
+    // Read RPC arguments into the pooled argument list. Each value is copied to an aligned slot in s_arg_storage.
+    for( idx = 0; idx < nparams; idx++ )
+    {
+        if( ( size_t )( p_request_end - p_request_offset ) < sizeof( size_t ) )
+        {
+            return false;
+        }
+
+        memcpy( &arg_size, p_request_offset, sizeof( size_t ) );
+        p_request_offset += sizeof( size_t );
+
+        if( arg_size > ( size_t )( p_request_end - p_request_offset ) )
+        {
+            return false;
+        }
+
+        s_arg_pool[idx].arg_size = arg_size;
+        s_arg_pool[idx].arg_val = p_arg_storage_offset;
+        s_arg_pool[idx].next = ( idx + 1 < nparams ) ? &s_arg_pool[idx + 1] : NULL;
+        memcpy( p_arg_storage_offset, p_request_offset, arg_size );
+        p_arg_storage_offset += ( arg_size + ARG_ALIGNMENT - 1 ) & ~( size_t )( ARG_ALIGNMENT - 1 );
+        p_request_offset += arg_size;
+    }
+
+    *p_nparams = nparams;
+
+    return true;
+}
+
+/**
+ * @brief This function decodes a whole request from a client into the pooled argument list.
+ *
+ * @param p_request              The buffer containing the remote procedure call arguments from the client.
+ * @param request_size           The number of bytes in p_request.
+ * @param sp_rpc_header          Receives the header of the request.
+ * @param psp_procedure_element  Receives the requested procedure, or NULL if it has not been registered.
+ * @param p_nparams              Receives the number of arguments in the pooled argument list.
+ *
+ * @return Returns true if the request was decoded. Returns false if the request is malformed.
+ */
+static bool decode_request( const char* p_request, int request_size, struct rpc_header* sp_rpc_header, struct procedure_element** psp_procedure_element, uint32_t* p_nparams )
+{
+    const char* p_args; ///< The number of arguments that follows the procedure name.
+
+    return decode_request_header( p_request, request_size, sp_rpc_header, psp_procedure_element, &p_args )
+           && decode_request_args( p_args, p_request + request_size, sp_rpc_header, p_nparams );
+}
+
+/**
+ * @brief This function invokes a regular procedure with the pooled argument list.
+ *
+ * @param sp_procedure_element The procedure to be invoked, or NULL.
+ * @param nparams              The number of arguments in the pooled argument list.
+ *
+ * @return Returns the return value of the procedure. Returns a NULL return value if the procedure
+ *         has not been registered as a regular procedure.
+ */
+static return_type invoke_procedure( const struct procedure_element* sp_procedure_element, uint32_t nparams )
+{
+    return_type s_return_type; ///< Stores the return value pertaining to the remote procedure call.
+
+    if( sp_procedure_element != NULL && sp_procedure_element->m_fnpointer != NULL )
+    {
+        // Call the registered function and pass in RPC argument linked list.
+        return ( *sp_procedure_element->m_fnpointer )( nparams, nparams > 0 ? s_arg_pool : NULL );
+    }
+
+    // Set RPC return value to NULL if registered function does not exist.
+    s_return_type.return_size = 0;
+    s_return_type.return_val = NULL;
+    return s_return_type;
+}
+
+/**
+ * @brief This function sends a reply or stream chunk datagram to the client. The payload is
+ *        sent in place, without being copied into a send buffer, unless it is compressed.
+ *
+ * @param socket_descriptor      The socket to send from.
+ * @param sp_client_sockaddr_in  The socket address of the client, or NULL if socket_descriptor is connected.
+ * @param addrlen                The length of sp_client_sockaddr_in.
+ * @param flags                  The RPC_FLAG_* values to be set in the header.
+ * @param seq                    The sequence number to be set in the header.
+ * @param request_id             The ID of the request being answered.
+ * @param p_payload              The return value or chunk to be sent.
+ * @param payload_size           The size of p_payload in bytes.
+ * @param compress               Whether the client accepts a compressed payload.
+ *
+ * @return Returns true if the datagram was sent.
+ */
+static bool send_datagram( int socket_descriptor, const struct sockaddr_in* sp_client_sockaddr_in, socklen_t addrlen, uint32_t flags, uint32_t seq, uint64_t request_id, const void* p_payload, size_t payload_size, bool compress )
+{
+    struct rpc_header s_rpc_header; ///< The header of the datagram.
+    struct iovec s_iovec[3];        ///< The header, the size of the payload and the payload.
+    struct msghdr s_msghdr;         ///< Describes the datagram.
+    int compressed_size = 0;        ///< The size of the compressed payload, or 0 if it is sent uncompressed.
+
+    if( p_payload == NULL )
+    {
+        payload_size = 0;
+    }
+
+    // Compress a large enough payload, but only send the compressed bytes if they are smaller.
+    if( compress && rpc_compression_threshold >= 0 && payload_size >= ( size_t )rpc_compression_threshold && payload_size <= BUFFER_SIZE )
+    {
+        compressed_size = rpc_compress( p_payload, payload_size, s_deflate_buffer, payload_size - 1 );
+    }
+
+    s_rpc_header.m_flags = flags;
+    s_rpc_header.m_seq = seq;
+    s_rpc_header.m_request_id = request_id;
+
+    s_iovec[0].iov_base = &s_rpc_header;
+    s_iovec[0].iov_len = sizeof( s_rpc_header );
+    s_iovec[1].iov_base = &payload_size;
+    s_iovec[1].iov_len = sizeof( size_t );
+    s_iovec[2].iov_base = ( void* )p_payload;
+    s_iovec[2].iov_len = payload_size;
+
+    if( compressed_size > 0 )
+    {
+        s_rpc_header.m_flags |= RPC_FLAG_COMPRESSED;
+        s_iovec[2].iov_base = s_deflate_buffer;
+        s_iovec[2].iov_len = compressed_size;
+    }
+
+    memset( &s_msghdr, 0, sizeof( s_msghdr ) );
+    s_msghdr.msg_name = ( void* )sp_client_sockaddr_in;
+    s_msghdr.msg_namelen = addrlen;
+    s_msghdr.msg_iov = s_iovec;
+    s_msghdr.msg_iovlen = payload_size > 0 ? 3 : 2;
+
+    if( sendmsg( socket_descriptor, &s_msghdr, 0 ) < 0 )
+    {
+        perror( "Could not return result to client." );
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief This function sends the return value of a remote procedure call to the client.
+ *
+ * @param socket_descriptor      The server socket.
+ * @param sp_client_sockaddr_in  The socket address of the client.
+ * @param addrlen                The length of sp_client_sockaddr_in.
+ * @param request_id             The ID of the request being answered, which the client matches the reply by.
+ * @param s_return_type          The return value to be sent.
+ * @param compress               Whether the client accepts a compressed return value.
+ */
+static void send_reply( int socket_descriptor, const struct sockaddr_in* sp_client_sockaddr_in, socklen_t addrlen, uint64_t request_id, return_type s_return_type, bool compress )
+{
+    send_datagram( socket_descriptor, sp_client_sockaddr_in, addrlen, 0, 0, request_id, s_return_type.return_val, s_return_type.return_size > 0 ? s_return_type.return_size : 0, compress );
+}
+
+/**
+ * @brief This function answers a request that is malformed or was rejected with an empty reply.
+ *
+ * @param socket_descriptor     The socket the reply is sent on.
+ * @param sp_client_sockaddr_in The socket address of the client.
+ * @param addrlen               The length of sp_client_sockaddr_in.
+ * @param request_id            The ID of the request being answered.
+ */
+static void send_empty_reply( int socket_descriptor, const struct sockaddr_in* sp_client_sockaddr_in, socklen_t addrlen, uint64_t request_id )
+{
+    return_type s_return_type; ///< The empty return value.
+
+    s_return_type.return_size = 0;
+    s_return_type.return_val = NULL;
+    send_reply( socket_descriptor, sp_client_sockaddr_in, addrlen, request_id, s_return_type, false );
+}
+
+/**
+ * @brief This function is the writer handed to streaming procedures. It splits the chunk into
+ *        datagrams and waits for credit from the client whenever it is RPC_STREAM_WINDOW chunks ahead.
+ *
+ * @param p_stream   The stream being produced.
+ * @param p_chunk    The next part of the result.
+ * @param chunk_size The size of p_chunk in bytes.
+ *
+ * @return Returns false if the client has gone away.
+ */
+static bool write_stream_chunk( rpc_stream* p_stream, const void* p_chunk, const int chunk_size )
+{
+    const char* p_chunk_offset = ( const char* )p_chunk; ///< Pointer to the part of p_chunk still to be sent.
+    size_t remaining = chunk_size > 0 ? chunk_size : 0;  ///< The number of bytes of p_chunk still to be sent.
+    size_t datagram_payload_size;                        ///< The number of bytes sent in the current datagram.
+    struct rpc_header s_credit;                          ///< A credit received from the client.
+
+    while( remaining > 0 && !p_stream->m_failed )
+    {
+        // Wait until the client has consumed enough of the stream.
+        while( p_stream->m_seq >= p_stream->m_credit )
+        {
+            if( recv( p_stream->m_socket_descriptor, &s_credit, sizeof( s_credit ), 0 ) < ( int )sizeof( s_credit ) )
+            {
+                p_stream->m_failed = true;
+                return false;
+            }
+
+            if( ( s_credit.m_flags & RPC_FLAG_STREAM_CREDIT ) && s_credit.m_seq > p_stream->m_credit )
+            {
+                p_stream->m_credit = s_credit.m_seq;
+            }
+        }
+
+        datagram_payload_size = remaining < REPLY_CAPACITY ? remaining : REPLY_CAPACITY;
+
+        if( !send_datagram( p_stream->m_socket_descriptor, NULL, 0, RPC_FLAG_STREAM, p_stream->m_seq, p_stream->m_request_id, p_chunk_offset, datagram_payload_size, p_stream->m_compress ) )
+        {
+            p_stream->m_failed = true;
+            return false;
+        }
+
+        p_stream->m_seq++;
+        p_chunk_offset += datagram_payload_size;
+        remaining -= datagram_payload_size;
+    }
+
+    return !p_stream->m_failed;
+}
+
+/**
+ * @brief This function serves a request from a client that consumes the result as a stream. The
+ *        chunks are sent from a socket dedicated to the stream, so the client's credits never reach
+ *        the server socket. The stream socket is connected to the client, so a client that goes away
+ *        is noticed as soon as the kernel reports its port unreachable. A regular procedure is
+ *        streamed as a single chunk.
+ *
+ * @param socket_descriptor      The server socket.
+ * @param sp_client_sockaddr_in  The socket address of the client.
+ * @param addrlen                The length of sp_client_sockaddr_in.
+ * @param request_id             The ID of the request being answered.
+ * @param sp_procedure_element   The requested procedure, or NULL.
+ * @param nparams                The number of arguments in the pooled argument list.
+ * @param compress               Whether the client accepts compressed chunks.
+ */
+static void serve_stream( int socket_descriptor, const struct sockaddr_in* sp_client_sockaddr_in, socklen_t addrlen, uint64_t request_id, const struct procedure_element* sp_procedure_element, uint32_t nparams, bool compress )
+{
+    rpc_stream s_stream;                      ///< The stream being produced.
+    struct sockaddr_in s_stream_sockaddr_in;  ///< The address the stream socket is bound to.
+    struct timeval s_timeout;                 ///< How long to wait for credit from the client.
+    return_type s_return_type;                ///< Stores the return value of a regular procedure.
+
+    memset( &s_stream, 0, sizeof( s_stream ) );
+    s_stream.m_credit = RPC_STREAM_WINDOW;
+    s_stream.m_compress = compress;
+    s_stream.m_request_id = request_id;
+    s_stream.m_socket_descriptor = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    memset( &s_stream_sockaddr_in, 0, sizeof( s_stream_sockaddr_in ) );
+    s_stream_sockaddr_in.sin_family = AF_INET;
+    s_stream_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    if( s_stream.m_socket_descriptor < 0 || bind( s_stream.m_socket_descriptor, ( struct sockaddr* )&s_stream_sockaddr_in, sizeof( s_stream_sockaddr_in ) ) < 0
+        || connect( s_stream.m_socket_descriptor, ( const struct sockaddr* )sp_client_sockaddr_in, addrlen ) < 0 )
+    {
+        // Without a stream socket, answer with a regular reply, which the client rejects as a malformed stream.
+        perror( "Could not create stream socket." );
+
+        if( s_stream.m_socket_descriptor >= 0 )
+        {
+            close( s_stream.m_socket_descriptor );
+        }
+
+        send_datagram( socket_descriptor, sp_client_sockaddr_in, addrlen, 0, 0, request_id, NULL, 0, false );
+        return;
+    }
+
+    // Give up on a client that stops granting credit.
+    s_timeout.tv_sec = RPC_STREAM_TIMEOUT_SEC;
+    s_timeout.tv_usec = 0;
+    setsockopt( s_stream.m_socket_descriptor, SOL_SOCKET, SO_RCVTIMEO, &s_timeout, sizeof( s_timeout ) );
+
+    if( sp_procedure_element != NULL && sp_procedure_element->m_stream_fnpointer != NULL )
+    {
+        ( *sp_procedure_element->m_stream_fnpointer )( nparams, nparams > 0 ? s_arg_pool : NULL, write_stream_chunk, &s_stream );
+    }
+    else
+    {
+        s_return_type = invoke_procedure( sp_procedure_element, nparams );
+        write_stream_chunk( &s_stream, s_return_type.return_val, s_return_type.return_size );
+    }
+
+    // Mark the end of the stream.
+    if( !s_stream.m_failed )
+    {
+        send_datagram( s_stream.m_socket_descriptor, NULL, 0, RPC_FLAG_STREAM | RPC_FLAG_STREAM_END, s_stream.m_seq, request_id, NULL, 0, false );
+    }
+
+    close( s_stream.m_socket_descriptor );
+}
+
+/**
+ * @brief This function runs a decoded request and answers the client, on whichever thread it was dispatched to.
+ *        The run time of RPC_EXEC_AUTO procedures is measured to decide where they run next.
+ *
+ * @param socket_descriptor      The server socket.
+ * @param sp_client_sockaddr_in  The socket address of the client.
+ * @param addrlen                The length of sp_client_sockaddr_in.
+ * @param sp_rpc_header          The header of the request.
+ * @param sp_procedure_element   The requested procedure, or NULL.
+ * @param nparams                The number of arguments in the pooled argument list.
+ * @param recv_ticks             When the request was received, in trace ticks.
+ * @param dispatch_ticks         When the request started running, in trace ticks. The receive loop passes
+ *                               recv_ticks, which saves a clock read.
+ */
+static void dispatch_request( int socket_descriptor, const struct sockaddr_in* sp_client_sockaddr_in, socklen_t addrlen, const struct rpc_header* sp_rpc_header, struct procedure_element* sp_procedure_element, uint32_t nparams, uint64_t recv_ticks, uint64_t dispatch_ticks )
+{
+    bool compress = ( sp_rpc_header->m_flags & RPC_FLAG_ACCEPT_COMPRESSED ) != 0; ///< Whether the client accepts a compressed reply.
+    bool measure = sp_procedure_element != NULL && sp_procedure_element->m_exec_hint == RPC_EXEC_AUTO; ///< Whether the run time is measured.
+    bool timed = measure || ( sp_rpc_header->m_flags & ( RPC_FLAG_TRACE_SAMPLED | RPC_FLAG_STREAM ) ) != 0;  ///< Whether the procedure is timed separately from the reply.
+    uint64_t handler_ticks = 0;                                                    ///< When the procedure returned, if it is timed.
+    uint64_t run_ns;                                                               ///< The run time of the procedure.
+    uint64_t latency_ns;                                                           ///< The updated average run time.
+    return_type s_return_type;                                                     ///< Stores the return value pertaining to the remote procedure call.
+
+    if( sp_rpc_header->m_flags & RPC_FLAG_STREAM )
+    {
+        // The client consumes the result as a stream, which is answered in chunks rather than one reply.
+        serve_stream( socket_descriptor, sp_client_sockaddr_in, addrlen, sp_rpc_header->m_request_id, sp_procedure_element, nparams, compress );
+        handler_ticks = trace_now();
+    }
+    else
+    {
+        // Invoke the registered procedure. Each clock read is a sizable part of the tracing cost of a short request,
+        // so the procedure is only timed separately from the reply when its requests are sampled or measured.
+        s_return_type = invoke_procedure( sp_procedure_element, nparams );
+        handler_ticks = timed ? trace_now() : 0;
+        send_reply( socket_descriptor, sp_client_sockaddr_in, addrlen, sp_rpc_header->m_request_id, s_return_type, compress );
+    }
+
+    // Record the request in this thread's trace ring.
+    trace_request( sp_rpc_header->m_request_id, sp_procedure_element != NULL ? sp_procedure_element->m_procedure_name : NULL,
+                   sp_client_sockaddr_in->sin_addr.s_addr, sp_client_sockaddr_in->sin_port,
+                   ( ( sp_rpc_header->m_flags & RPC_FLAG_TRACE_SAMPLED ) ? TRACE_FLAG_SAMPLED : 0 ) | ( ( sp_rpc_header->m_flags & RPC_FLAG_STREAM ) ? TRACE_FLAG_STREAM : 0 ),
+                   recv_ticks, dispatch_ticks, handler_ticks );
+
+    if( measure )
+    {
+        // Keep a moving average over roughly the last 8 calls. Offload above AUTO_OFFLOAD_NS, and only come back
+        // inline below half of it, so a procedure near the threshold does not flip back and forth. The run time
+        // comes from the trace timestamps, so measuring it takes no extra clock reads.
+        run_ns = trace_ticks_to_ns( handler_ticks - dispatch_ticks );
+        latency_ns = __atomic_load_n( &sp_procedure_element->m_latency_ns, __ATOMIC_RELAXED );
+        latency_ns = latency_ns == 0 ? run_ns : latency_ns - latency_ns / 8 + run_ns / 8;
+        __atomic_store_n( &sp_procedure_element->m_latency_ns, latency_ns, __ATOMIC_RELAXED );
+
+        if( latency_ns > AUTO_OFFLOAD_NS || latency_ns < AUTO_OFFLOAD_NS / 2 )
+        {
+            __atomic_store_n( &sp_procedure_element->m_offloaded, latency_ns > AUTO_OFFLOAD_NS, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+/**
+ * @brief This function takes a work item from the free list, allocating one if the free list is empty.
+ *
+ * @return Returns a work item, or NULL if MAX_PENDING_WORK_ITEMS requests are already waiting for a worker.
+ */
+static struct work_item* acquire_work_item()
+{
+    struct work_item* sp_work_item = NULL; ///< The work item to be returned.
+
+    pthread_mutex_lock( &s_work_item_mutex );
+
+    if( s_pending_work_items < MAX_PENDING_WORK_ITEMS )
+    {
+        sp_work_item = sp_free_work_items;
+
+        if( sp_work_item != NULL )
+        {
+            sp_free_work_items = sp_work_item->m_sp_next;
+        }
+        else
+        {
+            sp_work_item = ( struct work_item* )malloc( sizeof( struct work_item ) );
+        }
+
+        if( sp_work_item != NULL )
+        {
+            s_pending_work_items++;
+        }
+    }
+
+    pthread_mutex_unlock( &s_work_item_mutex );
+
+    return sp_work_item;
+}
+
+/**
+ * @brief This function returns a work item to the free list.
+ *
+ * @param sp_work_item The work item that has been served.
+ */
+static void release_work_item( struct work_item* sp_work_item )
+{
+    pthread_mutex_lock( &s_work_item_mutex );
+    sp_work_item->m_sp_next = sp_free_work_items;
+    sp_free_work_items = sp_work_item;
+    s_pending_work_items--;
+    pthread_mutex_unlock( &s_work_item_mutex );
+}
+
+/**
+ * @brief This function appends a work item to a work queue and wakes one of its workers.
+ *
+ * @param sp_work_queue The queue to append to.
+ * @param sp_work_item  The work item to be served.
+ */
+static void enqueue_work_item( struct work_queue* sp_work_queue, struct work_item* sp_work_item )
+{
+    sp_work_item->m_sp_next = NULL;
+
+    pthread_mutex_lock( &sp_work_queue->m_mutex );
+
+    if( sp_work_queue->m_sp_tail == NULL )
+    {
+        sp_work_queue->m_sp_head = sp_work_item;
+    }
+    else
+    {
+        sp_work_queue->m_sp_tail->m_sp_next = sp_work_item;
+    }
+
+    sp_work_queue->m_sp_tail = sp_work_item;
+
+    pthread_cond_signal( &sp_work_queue->m_cond );
+    pthread_mutex_unlock( &sp_work_queue->m_mutex );
+}
+
+/**
+ * @brief This function decodes the arguments of a handed-off request into this thread's argument list, serves it
+ *        and recycles its work item. The receive loop only decoded the header and procedure name.
+ *
+ * @param sp_work_item The request.
+ */
+static void serve_work_item( struct work_item* sp_work_item )
+{
+    struct rpc_header s_rpc_header;                 ///< The header of the request.
+    struct procedure_element* sp_procedure_element; ///< The requested procedure.
+    uint32_t nparams;                               ///< The number of arguments of the request.
+
+    if( decode_request( sp_work_item->m_buffer, sp_work_item->m_size, &s_rpc_header, &sp_procedure_element, &nparams ) )
+    {
+        dispatch_request( s_server_socket_descriptor, &sp_work_item->m_client_sockaddr_in, sp_work_item->m_addrlen, &s_rpc_header, sp_procedure_element, nparams, sp_work_item->m_recv_ticks, trace_clock() );
+    }
+    else
+    {
+        send_empty_reply( s_server_socket_descriptor, &sp_work_item->m_client_sockaddr_in, sp_work_item->m_addrlen, s_rpc_header.m_request_id );
+    }
+
+    release_work_item( sp_work_item );
+}
+
+/**
+ * @brief This function is the body of a worker thread. It serves the requests of one work queue forever.
+ *
+ * @param p_work_queue The work queue to be served.
+ *
+ * @return Never returns.
+ */
+static void* worker_main( void* p_work_queue )
+{
+    struct work_queue* sp_work_queue = ( struct work_queue* )p_work_queue; ///< The work queue to be served.
+    struct work_item* sp_work_item;                                        ///< The request being served.
+
+    trace_attach_thread();
+
+    while( true )
+    {
+        pthread_mutex_lock( &sp_work_queue->m_mutex );
+
+        while( sp_work_queue->m_sp_head == NULL )
+        {
+            trace_idle();
+            pthread_cond_wait( &sp_work_queue->m_cond, &sp_work_queue->m_mutex );
+        }
+
+        sp_work_item = sp_work_queue->m_sp_head;
+        sp_work_queue->m_sp_head = sp_work_item->m_sp_next;
+
+        if( sp_work_queue->m_sp_head == NULL )
+        {
+            sp_work_queue->m_sp_tail = NULL;
+        }
+
+        pthread_mutex_unlock( &sp_work_queue->m_mutex );
+
+        serve_work_item( sp_work_item );
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief This function is the main function of a thread serving one stream.
+ *
+ * @param p_work_item The stream request.
+ */
+static void* stream_thread_main( void* p_work_item )
+{
+    trace_attach_thread();
+    serve_work_item( ( struct work_item* )p_work_item );
+    trace_detach_thread();
+    __atomic_sub_fetch( &s_stream_thread_count, 1, __ATOMIC_RELAXED );
+
+    return NULL;
+}
+
+/**
+ * @brief This function starts a detached thread serving requests.
+ *
+ * @param fp_thread_main The main function of the thread.
+ * @param p_arg          The argument passed to fp_thread_main.
+ *
+ * @return Returns true if the thread was started.
+ */
+static bool start_thread( void* ( *fp_thread_main )( void* ), void* p_arg )
+{
+    pthread_t thread;            ///< The new thread.
+    int result;                  ///< The result of pthread_create().
+
+    // The thread inherits the mask of the receive loop, which blocks the trace dump signal.
+    result = pthread_create( &thread, NULL, fp_thread_main, p_arg );
+
+    if( result != 0 )
+    {
+        perror( "Could not start server thread." );
+        return false;
+    }
+
+    pthread_detach( thread );
+    return true;
+}
+
+/**
+ * @brief This function starts a detached worker thread serving a work queue.
+ *
+ * @param sp_work_queue The work queue to be served.
+ *
+ * @return Returns true if the thread was started.
+ */
+static bool start_worker( struct work_queue* sp_work_queue )
+{
+    return start_thread( worker_main, sp_work_queue );
+}
+
+/**
+ * @brief This function starts a thread serving one stream, unless MAX_STREAM_THREADS streams are in progress.
+ *
+ * @param sp_work_item The stream request. The thread recycles it.
+ *
+ * @return Returns true if the thread was started. Returns false if the caller still owns sp_work_item.
+ */
+static bool start_stream_thread( struct work_item* sp_work_item )
+{
+    if( __atomic_add_fetch( &s_stream_thread_count, 1, __ATOMIC_RELAXED ) <= MAX_STREAM_THREADS && start_thread( stream_thread_main, sp_work_item ) )
+    {
+        return true;
+    }
+
+    __atomic_sub_fetch( &s_stream_thread_count, 1, __ATOMIC_RELAXED );
+    return false;
+}
+
+/**
+ * @brief This function starts the worker threads needed by the registered procedures: the shared pool if any
+ *        procedure may run on it, and a dedicated worker for each RPC_EXEC_DEDICATED procedure. A procedure
+ *        whose worker could not be started runs inline.
+ */
+static void start_workers()
+{
+    struct procedure_element* sp_procedure_element; ///< The current element in the procedure element linked list.
+    bool pool_needed = false;                       ///< Whether any procedure may run on the shared pool.
+    unsigned int idx;                               ///< An index for for loops.
+
+    for( sp_procedure_element = sp_procedure_list_head_element; sp_procedure_element != NULL; sp_procedure_element = sp_procedure_element->m_sp_next_procedure_element )
+    {
+        if( sp_procedure_element->m_exec_hint == RPC_EXEC_POOLED || sp_procedure_element->m_exec_hint == RPC_EXEC_AUTO )
+        {
+            pool_needed = true;
+        }
+        else if( sp_procedure_element->m_exec_hint == RPC_EXEC_DEDICATED )
+        {
+            sp_procedure_element->m_sp_work_queue = ( struct work_queue* )malloc( sizeof( struct work_queue ) );
+
+            if( sp_procedure_element->m_sp_work_queue == NULL )
+            {
+                continue;
+            }
+
+            pthread_mutex_init( &sp_procedure_element->m_sp_work_queue->m_mutex, NULL );
+            pthread_cond_init( &sp_procedure_element->m_sp_work_queue->m_cond, NULL );
+            sp_procedure_element->m_sp_work_queue->m_sp_head = NULL;
+            sp_procedure_element->m_sp_work_queue->m_sp_tail = NULL;
+
+            if( !start_worker( sp_procedure_element->m_sp_work_queue ) )
+            {
+                free( sp_procedure_element->m_sp_work_queue );
+                sp_procedure_element->m_sp_work_queue = NULL;
+            }
+        }
+    }
+
+    for( idx = 0; pool_needed && idx < WORKER_POOL_SIZE; idx++ )
+    {
+        s_worker_pool_started = start_worker( &s_worker_pool_queue ) || s_worker_pool_started;
+    }
+}
+
+/**
+ * @brief This function chooses where a request for a procedure runs.
+ *
+ * @param sp_procedure_element The requested procedure, or NULL.
+ *
+ * @return Returns the work queue the request is handed off to, or NULL if it runs inline on the receive loop.
+ */
+static struct work_queue* select_work_queue( const struct procedure_element* sp_procedure_element )
+{
+    if( sp_procedure_element == NULL )
+    {
+        return NULL;
+    }
+
+    switch( sp_procedure_element->m_exec_hint )
+    {
+        case RPC_EXEC_DEDICATED:
+            return sp_procedure_element->m_sp_work_queue;
+        case RPC_EXEC_POOLED:
+            return s_worker_pool_started ? &s_worker_pool_queue : NULL;
+        case RPC_EXEC_AUTO:
+            return s_worker_pool_started && __atomic_load_n( &sp_procedure_element->m_offloaded, __ATOMIC_RELAXED ) ? &s_worker_pool_queue : NULL;
+        default:
+            return NULL;
+    }
+}
+
+/** @struct
+
+    @brief Defines the stream a trace dump is written to.
+*/
+struct trace_stream_sink
+{
+    stream_writer_type m_writer;   ///< The writer passed to the streaming procedure
+    rpc_stream*        m_p_stream; ///< The stream to the client
+};
+
+/**
+ * @brief This function passes trace dump text to the writer of a stream.
+ */
+static bool write_trace_to_stream( void* p_trace_stream_sink, const char* p_text, int size )
+{
+    struct trace_stream_sink* sp_trace_stream_sink = ( struct trace_stream_sink* )p_trace_stream_sink; ///< The stream being written.
+
+    return sp_trace_stream_sink->m_writer( sp_trace_stream_sink->m_p_stream, p_text, size );
+}
+
+/**
+ * @brief This function is the streaming procedure registered as RPC_TRACE_DUMP_PROCEDURE. It streams the trace
+ *        dump to the client.
+ *
+ * @param nparams  The number of arguments: 0, or 1 for the sampled_only flag.
+ * @param a        The optional int sampled_only flag.
+ * @param writer   The writer of the stream.
+ * @param p_stream The stream to the client.
+ */
+static void trace_dump_procedure( const int nparams, arg_type* a, stream_writer_type writer, rpc_stream* p_stream )
+{
+    bool sampled_only = nparams > 0 && a->arg_size == sizeof( int ) && *( int* )a->arg_val != 0; ///< Whether only sampled requests are dumped.
+    struct trace_stream_sink s_trace_stream_sink = { writer, p_stream };                           ///< The stream the dump is written to.
+
+    trace_dump( write_trace_to_stream, &s_trace_stream_sink, sampled_only );
+}
+
+/**
+ * @brief This function writes the trace dump to rpc_trace.<pid>.json in the working directory.
+ */
+static void write_trace_file()
+{
+    char path[64]; ///< The path of the trace file.
+    int fd;        ///< The trace file.
+
+    // Include the request this thread served last.
+    trace_idle();
+    snprintf( path, sizeof( path ), "rpc_trace.%d.json", ( int )getpid() );
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+
+    if( fd < 0 )
+    {
+        perror( "Could not create trace file." );
+        return;
+    }
+
+    if( !rpc_dump_trace( fd, false ) )
+    {
+        perror( "Could not write trace file." );
+    }
+
+    close( fd );
+}
+
+/**
+ * @brief This function writes the trace file if the trace dump signal has arrived since it was last checked.
+ *
+ * @param trace_dump_fd The non-blocking signalfd of the trace dump signal.
+ */
+static void check_trace_dump_signal( int trace_dump_fd )
+{
+    struct signalfd_siginfo s_signalfd_siginfo; ///< A pending trace dump signal.
+    bool requested = false;                     ///< Whether the signal has arrived.
+
+    while( read( trace_dump_fd, &s_signalfd_siginfo, sizeof( s_signalfd_siginfo ) ) == sizeof( s_signalfd_siginfo ) )
+    {
+        requested = true;
+    }
+
+    if( requested )
+    {
+        write_trace_file();
+    }
+}
+
+/**
+ * @brief This function waits until a request arrives on the server socket, writing the trace file whenever the
+ *        trace dump signal arrives meanwhile.
+ *
+ * @param socket_descriptor The server socket.
+ * @param trace_dump_fd     The non-blocking signalfd of the trace dump signal.
+ */
+static void wait_for_request( int socket_descriptor, int trace_dump_fd )
+{
+    struct pollfd s_pollfds[2] = { { socket_descriptor, POLLIN, 0 }, { trace_dump_fd, POLLIN, 0 } }; ///< The server socket and the signalfd.
+
+    if( poll( s_pollfds, 2, -1 ) > 0 && ( s_pollfds[1].revents & POLLIN ) )
+    {
+        check_trace_dump_signal( trace_dump_fd );
+    }
+}
+
+/**
+ * @brief This function starts the server listening for requests for function calls
+ *        to functions registered by the server stub.
+ */
+void launch_server()
+{
+    int socket_descriptor;                    ///< Stores a files descriptor pertaining to a server socket.
+    int recv_size_bytes;                      ///< Stores the number of bytes received from the client.
+    char server_ip_addr[INET_ADDRSTRLEN];     ///< The IPv4 address of the server.
+    struct sockaddr_in s_server_sockaddr_in;  ///< Stores the server socket and port.
+    struct sockaddr_in s_client_sockaddr_in;  ///< Stores the client socket and port.
+    socklen_t addrlen;                        ///< Stores the length of s_client_sockaddr_in.
+    struct rpc_header s_rpc_header;           ///< The header of the request.
+    struct procedure_element* sp_procedure_element; ///< The requested procedure.
+    uint32_t nparams;                         ///< The number of arguments of the request.
+    const char* p_args;                       ///< The arguments of the request, following the procedure name.
+    bool stream;                              ///< Whether the request is answered as a stream.
+    struct work_queue* sp_work_queue;         ///< The queue the request is handed off to, or NULL to serve it inline.
+    struct work_item* sp_work_item;           ///< The copy of the request handed off to a worker.
+    uint64_t recv_ticks;                      ///< When the request was received, in trace ticks.
+    sigset_t s_signal_set;                    ///< The trace dump signal.
+    int trace_dump_fd = -1;                   ///< The signalfd of the trace dump signal, or -1 if there is none.
+    int requests_since_dump_check = 0;        ///< Requests received since the signalfd was last read.
+
+    // Establish server socket
+    socket_descriptor = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    // If socket not established successfully, exit program.
+    if( socket_descriptor < 0 )
+    {
+        perror( "Could not create server socket." );
+        exit( 1 );
+    }
+
+    // Obtain the IP address of the current machine. The server listens on all interfaces, so loopback still works
+    // if no address can be found.
+    if( !return_ip_addr( sp_server_interface_name != NULL ? sp_server_interface_name : DEFAULT_INTERFACE_NAME, server_ip_addr, sizeof( server_ip_addr ) ) )
+    {
+        strcpy( server_ip_addr, "127.0.0.1" );
+    }
+
+    // Configure the server socket address and port number. Server can accept responses on all network interfaces.
+    memset( ( char* )&s_server_sockaddr_in, 0, sizeof( s_server_sockaddr_in ) );
+    s_server_sockaddr_in.sin_family = AF_INET;
+    s_server_sockaddr_in.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    // Bind address and port number to UDP socket. If bind unsuccessful, exit program.
+    if( !bind_server_socket( socket_descriptor, &s_server_sockaddr_in ) )
+    {
+        perror("Could not bind address and port number to server socket.");
+        exit( 1 );
+    }
+
+    // Start tracing, and let clients dump the trace.
+    trace_start();
+
+    if( find_procedure_element( RPC_TRACE_DUMP_PROCEDURE ) == NULL )
+    {
+        register_stream_procedure( RPC_TRACE_DUMP_PROCEDURE, 1, trace_dump_procedure );
+    }
+
+    // If a trace dump signal was set, receive it through a signalfd polled next to the socket. The signal stays
+    // blocked in this thread and the threads it starts, and the application's handlers are left alone.
+    if( s_trace_dump_signal != 0 )
+    {
+        sigemptyset( &s_signal_set );
+        sigaddset( &s_signal_set, s_trace_dump_signal );
+        pthread_sigmask( SIG_BLOCK, &s_signal_set, NULL );
+        trace_dump_fd = signalfd( -1, &s_signal_set, SFD_NONBLOCK | SFD_CLOEXEC );
+
+        if( trace_dump_fd < 0 )
+        {
+            perror( "Could not create trace dump signalfd." );
+        }
+    }
+
+    // Start the worker threads before announcing the server, so the first request does not pay for them.
+    s_server_socket_descriptor = socket_descriptor;
+    start_workers();
+
+    // Print server IPv4 address and port number to stdout. Flush it, since whoever waits for the server to be ready
+    // may be reading a pipe.
+    printf( "%s %d\n", server_ip_addr, ntohs( s_server_sockaddr_in.sin_port ) );
+    fflush( stdout );
+
+    // Loop forever.
+    while( true )
+    {
+        // While requests keep arriving, the socket is never polled, so check for the trace dump signal now and then.
+        if( trace_dump_fd >= 0 && ++requests_since_dump_check >= TRACE_DUMP_CHECK_INTERVAL )
+        {
+            requests_since_dump_check = 0;
+            check_trace_dump_signal( trace_dump_fd );
+        }
+
+        // Gets the length of s_client_sockaddr_in
+        addrlen = sizeof( s_client_sockaddr_in );
+
+        // Attempt to receive request from client into the pooled receive buffer. The first attempt does not block.
+        recv_size_bytes = recvfrom(socket_descriptor, s_recv_buffer, BUFFER_SIZE, MSG_DONTWAIT, (struct sockaddr*)&s_client_sockaddr_in, &addrlen);
+
+        if( recv_size_bytes < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            // No request is waiting. The last request waits for the clock read of the next one as its send time,
+            // so publish it before blocking. With a trace dump signal, poll the socket and the signalfd.
+            trace_idle();
+
+            if( trace_dump_fd >= 0 )
+            {
+                wait_for_request( socket_descriptor, trace_dump_fd );
+                continue;
+            }
+
+            addrlen = sizeof( s_client_sockaddr_in );
+            recv_size_bytes = recvfrom(socket_descriptor, s_recv_buffer, BUFFER_SIZE, 0, (struct sockaddr*)&s_client_sockaddr_in, &addrlen);
+        }
+
+        recv_ticks = trace_clock();
+
+        if( recv_size_bytes < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if (recv_size_bytes <= 0)
+        {
+            // If could not receive request from client, there is no client to answer.
+            perror( "Could not receive UDP packet from client." );
+            continue;
+        }
+
+        // Only the header and procedure name are needed to decide where the request runs.
+        if( !decode_request_header( s_recv_buffer, recv_size_bytes, &s_rpc_header, &sp_procedure_element, &p_args ) )
+        {
+            // Set RPC return value to NULL if the request is malformed.
+            send_empty_reply( socket_descriptor, &s_client_sockaddr_in, addrlen, s_rpc_header.m_request_id );
+            continue;
+        }
+
+        // A stream runs for as long as its client keeps reading, so each one gets a thread of its own. Other slow
+        // procedures are handed off to their worker.
+        stream = ( s_rpc_header.m_flags & RPC_FLAG_STREAM ) != 0;
+        sp_work_queue = stream ? NULL : select_work_queue( sp_procedure_element );
+
+        if( !stream && sp_work_queue == NULL )
+        {
+            if( decode_request_args( p_args, s_recv_buffer + recv_size_bytes, &s_rpc_header, &nparams ) )
+            {
+                dispatch_request( socket_descriptor, &s_client_sockaddr_in, addrlen, &s_rpc_header, sp_procedure_element, nparams, recv_ticks, recv_ticks );
+            }
+            else
+            {
+                send_empty_reply( socket_descriptor, &s_client_sockaddr_in, addrlen, s_rpc_header.m_request_id );
+            }
+
+            continue;
+        }
+
+        // Hand off the datagram as received; the serving thread decodes the arguments. If too many requests are
+        // already waiting, reject this one rather than run slow work on the receive loop.
+        sp_work_item = acquire_work_item();
+
+        if( sp_work_item != NULL )
+        {
+            memcpy( sp_work_item->m_buffer, s_recv_buffer, recv_size_bytes );
+            sp_work_item->m_size = recv_size_bytes;
+            sp_work_item->m_recv_ticks = recv_ticks;
+            sp_work_item->m_client_sockaddr_in = s_client_sockaddr_in;
+            sp_work_item->m_addrlen = addrlen;
+        }
+
+        if( sp_work_item == NULL )
+        {
+            send_empty_reply( socket_descriptor, &s_client_sockaddr_in, addrlen, s_rpc_header.m_request_id );
+        }
+        else if( !stream )
+        {
+            enqueue_work_item( sp_work_queue, sp_work_item );
+        }
+        else if( !start_stream_thread( sp_work_item ) )
+        {
+            release_work_item( sp_work_item );
+            send_empty_reply( socket_descriptor, &s_client_sockaddr_in, addrlen, s_rpc_header.m_request_id );
+        }
     }
 }
@@ -0,0 +1,122 @@
+/* Checks that remote calls allocate nothing once the stubs have warmed up. The test runs the server on a thread
+ * of its own process, and counts every heap allocation made by either side through a malloc shim. */
+#include <errno.h>
+#include <stdlib.h>
+#include "../bench/bench_util.h"
+#include "../ece454rpc_protocol.h"
+
+#define WARMUP_CALLS   100   ///< Calls made before counting starts, so every per-thread buffer and thread exists
+#define COUNTED_CALLS  10000 ///< Calls made while allocations are counted
+#define LARGE_ARG_SIZE 2048  ///< Size of the argument that is large enough to be compressed
+
+/* glibc's allocator, which the shim below forwards to. */
+extern void* __libc_malloc( size_t size );
+extern void* __libc_calloc( size_t count, size_t size );
+extern void* __libc_realloc( void* p, size_t size );
+extern void* __libc_memalign( size_t alignment, size_t size );
+
+/* Whether allocations are being counted, and how many were made. */
+static volatile int s_counting = 0;
+static unsigned long s_allocations = 0;
+
+void* malloc( size_t size )
+{
+    if( s_counting )
+    {
+        __atomic_add_fetch( &s_allocations, 1, __ATOMIC_RELAXED );
+    }
+
+    return __libc_malloc( size );
+}
+
+void* calloc( size_t count, size_t size )
+{
+    if( s_counting )
+    {
+        __atomic_add_fetch( &s_allocations, 1, __ATOMIC_RELAXED );
+    }
+
+    return __libc_calloc( count, size );
+}
+
+void* realloc( void* p, size_t size )
+{
+    if( s_counting )
+    {
+        __atomic_add_fetch( &s_allocations, 1, __ATOMIC_RELAXED );
+    }
+
+    return __libc_realloc( p, size );
+}
+
+int posix_memalign( void** pp, size_t alignment, size_t size )
+{
+    if( s_counting )
+    {
+        __atomic_add_fetch( &s_allocations, 1, __ATOMIC_RELAXED );
+    }
+
+    *pp = __libc_memalign( alignment, size );
+    return *pp != NULL ? 0 : ENOMEM;
+}
+
+/**
+ * @brief Calls echo and checks the reply.
+ *
+ * @return Returns true if the argument came back unchanged.
+ */
+static bool call_echo( int port, const void* p_arg, int arg_size )
+{
+    return_type s_return_type = make_remote_call_borrowed( "127.0.0.1", port, "echo", 1, arg_size, p_arg );
+    bool ok = s_return_type.return_size == arg_size && memcmp( s_return_type.return_val, p_arg, arg_size ) == 0;
+
+    release_return_value( &s_return_type );
+    return ok;
+}
+
+int main()
+{
+    char large_arg[LARGE_ARG_SIZE]; ///< A compressible argument.
+    int small_arg = 42;             ///< An argument too small to be compressed.
+    int port;                       ///< The port of the server.
+    int idx;                        ///< An index for for loops.
+
+    for( idx = 0; idx < LARGE_ARG_SIZE; idx++ )
+    {
+        large_arg[idx] = "abcdefgh"[idx % 8];
+    }
+
+    // Compression is off by default, and the compressed path must not allocate either.
+    rpc_set_compression_threshold( RPC_COMPRESSION_THRESHOLD );
+    register_procedure( "echo", 1, bench_echo );
+    port = bench_start_server();
+
+    if( port == 0 )
+    {
+        fprintf( stderr, "alloc_test: the server did not start.\n" );
+        return 1;
+    }
+
+    for( idx = 0; idx < WARMUP_CALLS; idx++ )
+    {
+        call_echo( port, &small_arg, sizeof( small_arg ) );
+        call_echo( port, large_arg, sizeof( large_arg ) );
+    }
+
+    s_counting = 1;
+
+    for( idx = 0; idx < COUNTED_CALLS; idx++ )
+    {
+        if( !call_echo( port, &small_arg, sizeof( small_arg ) ) || !call_echo( port, large_arg, sizeof( large_arg ) ) )
+        {
+            s_counting = 0;
+            fprintf( stderr, "alloc_test: call %d returned a wrong reply.\n", idx );
+            return 1;
+        }
+    }
+
+    s_counting = 0;
+    printf( "alloc_test: %lu allocations in %d calls\n", s_allocations, 2 * COUNTED_CALLS );
+
+    return s_allocations == 0 ? 0 : 1;
+}